@@ -24,6 +24,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <cfloat>
+#include <new>
 
 #if defined(IM3D_MALLOC) && !defined(IM3D_FREE)
 #error im3d: IM3D_MALLOC defined without IM3D_FREE; define both or neither
@@ -43,6 +44,9 @@
 #ifndef IM3D_CULL_GIZMOS
 #define IM3D_CULL_GIZMOS 0
 #endif
+#ifndef IM3D_INDEXED_PRIMITIVES
+#define IM3D_INDEXED_PRIMITIVES 0
+#endif
 
 // Compiler
 #if defined(__GNUC__)
@@ -53,6 +57,23 @@
 #error im3d: Compiler not defined
 #endif
 
+#ifndef IM3D_SIMD
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define IM3D_SIMD 1
+#else
+#define IM3D_SIMD 0
+#endif
+#endif
+#if IM3D_SIMD
+#include <immintrin.h>
+#if defined(IM3D_COMPILER_MSVC)
+#include <intrin.h>
+#define IM3D_TARGET_AVX2
+#else
+#define IM3D_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
 #if defined(IM3D_COMPILER_GNU)
 #define if_likely(e) if (__builtin_expect(!!(e), 1))
 #define if_unlikely(e) if (__builtin_expect(!!(e), 0))
@@ -100,6 +121,84 @@ Color::Color(float _r, float _g, float _b, float _a)
     v |= (U32)(_a * 255.0f);
 }
 
+#if IM3D_VERTEX_COMPACT
+namespace
+{
+// Round to nearest even, finite values outside the half range are clamped to +-65504.
+U16 FloatToHalf(float _f)
+{
+    U32 u;
+    memcpy(&u, &_f, sizeof(u));
+    const U32 sign = (u >> 16) & 0x8000u;
+    u &= 0x7fffffffu;
+    if (u >= 0x7f800000u)
+    { // inf/nan
+        return (U16)(sign | (u > 0x7f800000u ? 0x7e00u : 0x7c00u));
+    }
+    if (u >= 0x477ff000u)
+    { // rounds to inf
+        return (U16)(sign | 0x7bffu);
+    }
+    if (u < 0x38800000u)
+    { // subnormal or zero, let the fp adder do the rounding
+        const U32 denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        float magic;
+        memcpy(&magic, &denormMagic, sizeof(magic));
+        f += magic;
+        memcpy(&u, &f, sizeof(u));
+        return (U16)(sign | (u - denormMagic));
+    }
+    const U32 mantissaOdd = (u >> 13) & 1;
+    u += ((U32)(15 - 127) << 23) + 0xfffu + mantissaOdd;
+    return (U16)(sign | (u >> 13));
+}
+
+float HalfToFloat(U16 _h)
+{
+    U32 u = (U32)(_h & 0x7fffu) << 13;
+    const U32 exponent = u & (0x7c00u << 13);
+    u += (127 - 15) << 23;
+    if (exponent == (0x7c00u << 13))
+    { // inf/nan
+        u += (128 - 16) << 23;
+    }
+    else if (exponent == 0)
+    { // subnormal or zero
+        const U32 magicBits = 113 << 23;
+        float magic;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        u += 1 << 23;
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        f -= magic;
+        memcpy(&u, &f, sizeof(u));
+    }
+    u |= (U32)(_h & 0x8000u) << 16;
+    float ret;
+    memcpy(&ret, &u, sizeof(ret));
+    return ret;
+}
+} // namespace
+
+DrawVertex::DrawVertex(const Vec3 &_position, float _size, Color _color)
+    : m_size(FloatToHalf(_size)), m_color(_color), m_pad(0)
+{
+    m_position[0] = FloatToHalf(_position.x);
+    m_position[1] = FloatToHalf(_position.y);
+    m_position[2] = FloatToHalf(_position.z);
+}
+Vec3 DrawVertex::getPosition() const
+{
+    return Vec3(HalfToFloat(m_position[0]), HalfToFloat(m_position[1]), HalfToFloat(m_position[2]));
+}
+float DrawVertex::getSize() const
+{
+    return HalfToFloat(m_size);
+}
+#endif // IM3D_VERTEX_COMPACT
+
 void Im3d::MulMatrix(const Mat4 &_mat4)
 {
     Context &ctx = GetContext();
@@ -131,6 +230,29 @@ void Im3d::Scale(float _x, float _y, float _z)
     ctx.setMatrix(ctx.getMatrix() * Mat4(Scale(Vec3(_x, _y, _z))));
 }
 
+// Cull scope, occlusion and contribution culling for the Draw*() helpers, return true if the shape shouldn't be drawn (call before
+// estimating the level of detail). A single point is drawn in place of shapes which project to fewer pixels than
+// AppData::m_cullMinPixelSize.
+static bool CullShape(Context &_ctx, const Vec3 &_origin, float _radius)
+{
+    if (!_ctx.getCullScopeVisible())
+    {
+        return true;
+    }
+    if (_ctx.isOccluded(_origin, _radius))
+    {
+        return true;
+    }
+    if (!_ctx.isBelowMinPixelSize(_origin, _radius))
+    {
+        return false;
+    }
+    _ctx.begin(PrimitiveMode_Points);
+    _ctx.vertex(_origin);
+    _ctx.end();
+    return true;
+}
+
 void Im3d::DrawXyzAxes()
 {
     Context &ctx = GetContext();
@@ -213,6 +335,10 @@ void Im3d::DrawCircle(const Vec3 &_origin, const Vec3 &_normal, float _radius, i
         return;
     }
 #endif
+    if (CullShape(ctx, _origin, _radius))
+    {
+        return;
+    }
 
     if (_detail < 0)
     {
@@ -221,11 +347,11 @@ void Im3d::DrawCircle(const Vec3 &_origin, const Vec3 &_normal, float _radius, i
     _detail = Max(_detail, 3);
 
     ctx.pushMatrix(ctx.getMatrix() * LookAt(_origin, _origin + _normal, ctx.getAppData().m_worldUp));
+    const Vec2 *circle = ctx.getUnitCircle(_detail);
     ctx.begin(PrimitiveMode_LineLoop);
     for (int i = 0; i < _detail; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)_detail);
-        ctx.vertex(Vec3(cosf(rad) * _radius, sinf(rad) * _radius, 0.0f));
+        ctx.vertex(Vec3(circle[i].x * _radius, circle[i].y * _radius, 0.0f));
     }
     ctx.end();
     ctx.popMatrix();
@@ -239,6 +365,10 @@ void Im3d::DrawCircleFilled(const Vec3 &_origin, const Vec3 &_normal, float _rad
         return;
     }
 #endif
+    if (CullShape(ctx, _origin, _radius))
+    {
+        return;
+    }
 
     if (_detail < 0)
     {
@@ -247,6 +377,7 @@ void Im3d::DrawCircleFilled(const Vec3 &_origin, const Vec3 &_normal, float _rad
     _detail = Max(_detail, 3);
 
     ctx.pushMatrix(ctx.getMatrix() * LookAt(_origin, _origin + _normal, ctx.getAppData().m_worldUp));
+    const Vec2 *circle = ctx.getUnitCircle(_detail);
     ctx.begin(PrimitiveMode_Triangles);
     float cp = _radius;
     float sp = 0.0f;
@@ -254,9 +385,8 @@ void Im3d::DrawCircleFilled(const Vec3 &_origin, const Vec3 &_normal, float _rad
     {
         ctx.vertex(Vec3(0.0f, 0.0f, 0.0f));
         ctx.vertex(Vec3(cp, sp, 0.0f));
-        float rad = TwoPi * ((float)i / (float)_detail);
-        float c = cosf(rad) * _radius;
-        float s = sinf(rad) * _radius;
+        float c = circle[i].x * _radius;
+        float s = circle[i].y * _radius;
         ctx.vertex(Vec3(c, s, 0.0f));
         cp = c;
         sp = s;
@@ -273,6 +403,10 @@ void Im3d::DrawSphere(const Vec3 &_origin, float _radius, int _detail)
         return;
     }
 #endif
+    if (CullShape(ctx, _origin, _radius))
+    {
+        return;
+    }
 
     if (_detail < 0)
     {
@@ -280,28 +414,26 @@ void Im3d::DrawSphere(const Vec3 &_origin, float _radius, int _detail)
     }
     _detail = Max(_detail, 3);
 
+    const Vec2 *circle = ctx.getUnitCircle(_detail);
     // xy circle
     ctx.begin(PrimitiveMode_LineLoop);
     for (int i = 0; i < _detail; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)_detail);
-        ctx.vertex(Vec3(cosf(rad) * _radius + _origin.x, sinf(rad) * _radius + _origin.y, 0.0f + _origin.z));
+        ctx.vertex(Vec3(circle[i].x * _radius + _origin.x, circle[i].y * _radius + _origin.y, 0.0f + _origin.z));
     }
     ctx.end();
     // xz circle
     ctx.begin(PrimitiveMode_LineLoop);
     for (int i = 0; i < _detail; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)_detail);
-        ctx.vertex(Vec3(cosf(rad) * _radius + _origin.x, 0.0f + _origin.y, sinf(rad) * _radius + _origin.z));
+        ctx.vertex(Vec3(circle[i].x * _radius + _origin.x, 0.0f + _origin.y, circle[i].y * _radius + _origin.z));
     }
     ctx.end();
     // yz circle
     ctx.begin(PrimitiveMode_LineLoop);
     for (int i = 0; i < _detail; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)_detail);
-        ctx.vertex(Vec3(0.0f + _origin.x, cosf(rad) * _radius + _origin.y, sinf(rad) * _radius + _origin.z));
+        ctx.vertex(Vec3(0.0f + _origin.x, circle[i].x * _radius + _origin.y, circle[i].y * _radius + _origin.z));
     }
     ctx.end();
 }
@@ -314,6 +446,10 @@ void Im3d::DrawSphereFilled(const Vec3 &_origin, float _radius, int _detail)
         return;
     }
 #endif
+    if (CullShape(ctx, _origin, _radius))
+    {
+        return;
+    }
 
     if (_detail < 0)
     {
@@ -321,22 +457,23 @@ void Im3d::DrawSphereFilled(const Vec3 &_origin, float _radius, int _detail)
     }
     _detail = Max(_detail, 6);
 
+    // latitude angle i / (_detail / 2) * Pi - HalfPi, cos/sin are (sin, -cos) of the unit circle angle
+    const Vec2 *latitude = ctx.getUnitCircle((_detail / 2) * 2);
+    const Vec2 *longitude = ctx.getUnitCircle(_detail);
     ctx.begin(PrimitiveMode_Triangles);
     float yp = -_radius;
     float rp = 0.0f;
     for (int i = 1; i <= _detail / 2; ++i)
     {
-        float y = ((float)i / (float)(_detail / 2)) * 2.0f - 1.0f;
-        float r = cosf(y * HalfPi) * _radius;
-        y = sinf(y * HalfPi) * _radius;
+        float r = latitude[i].y * _radius;
+        float y = -latitude[i].x * _radius;
 
         float xp = 1.0f;
         float zp = 0.0f;
         for (int j = 1; j <= _detail; ++j)
         {
-            float x = ((float)j / (float)(_detail)) * TwoPi;
-            float z = sinf(x);
-            x = cosf(x);
+            float x = longitude[j].x;
+            float z = longitude[j].y;
 
             ctx.vertex(Vec3(xp * rp, yp, zp * rp));
             ctx.vertex(Vec3(xp * r, y, zp * r));
@@ -364,6 +501,10 @@ void Im3d::DrawAlignedBox(const Vec3 &_min, const Vec3 &_max)
         return;
     }
 #endif
+    if (CullShape(ctx, (_min + _max) * 0.5f, Length(_max - _min) * 0.5f))
+    {
+        return;
+    }
     ctx.begin(PrimitiveMode_LineLoop);
     ctx.vertex(Vec3(_min.x, _min.y, _min.z));
     ctx.vertex(Vec3(_max.x, _min.y, _min.z));
@@ -396,6 +537,10 @@ void Im3d::DrawAlignedBoxFilled(const Vec3 &_min, const Vec3 &_max)
         return;
     }
 #endif
+    if (CullShape(ctx, (_min + _max) * 0.5f, Length(_max - _min) * 0.5f))
+    {
+        return;
+    }
 
     ctx.pushEnableSorting(true);
     // x+
@@ -445,6 +590,10 @@ void Im3d::DrawCylinder(const Vec3 &_start, const Vec3 &_end, float _radius, int
         return;
     }
 #endif
+    if (CullShape(ctx, (_start + _end) * 0.5f, Length(_end - _start) * 0.5f + _radius))
+    {
+        return;
+    }
 
     Vec3 org = _start + (_end - _start) * 0.5f;
     if (_detail < 0)
@@ -454,27 +603,27 @@ void Im3d::DrawCylinder(const Vec3 &_start, const Vec3 &_end, float _radius, int
     _detail = Max(_detail, 3);
 
     float ln = Length(_end - _start) * 0.5f;
+    // angles are offset by -HalfPi, cos/sin are (sin, -cos) of the unit circle angle
+    const Vec2 *circle = ctx.getUnitCircle(_detail);
+    const Vec2 *sides = ctx.getUnitCircle(6);
     ctx.pushMatrix(ctx.getMatrix() * LookAt(org, _end, ctx.getAppData().m_worldUp));
     ctx.begin(PrimitiveMode_LineLoop);
     for (int i = 0; i <= _detail; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)_detail) - HalfPi;
-        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(circle[i].y, -circle[i].x, 0.0f) * _radius);
     }
     ctx.end();
     ctx.begin(PrimitiveMode_LineLoop);
     for (int i = 0; i <= _detail; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)_detail) - HalfPi;
-        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(circle[i].y, -circle[i].x, 0.0f) * _radius);
     }
     ctx.end();
     ctx.begin(PrimitiveMode_Lines);
     for (int i = 0; i <= 6; ++i)
     {
-        float rad = TwoPi * ((float)i / 6.0f) - HalfPi;
-        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
-        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(sides[i].y, -sides[i].x, 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(sides[i].y, -sides[i].x, 0.0f) * _radius);
     }
     ctx.end();
     ctx.popMatrix();
@@ -488,51 +637,51 @@ void Im3d::DrawCapsule(const Vec3 &_start, const Vec3 &_end, float _radius, int
         return;
     }
 #endif
+    if (CullShape(ctx, (_start + _end) * 0.5f, Length(_end - _start) * 0.5f + _radius))
+    {
+        return;
+    }
 
     Vec3 org = _start + (_end - _start) * 0.5f;
     if (_detail < 0)
     {
-        _detail = ctx.estimateLevelOfDetail(org, _radius, 6, 24);
+        _detail = ctx.estimateLevelOfDetail(org, _radius, 12, 48) / 2; // _detail is the half circle segment count
     }
     _detail = Max(_detail, 3);
 
     float ln = Length(_end - _start) * 0.5f;
     int detail2 = _detail * 2; // force cap base detail to match ends
+    // the cap half circles (angle Pi * i / _detail) index the same table; cap base angles are offset by -HalfPi, cos/sin are (sin, -cos)
+    const Vec2 *circle = ctx.getUnitCircle(detail2);
     ctx.pushMatrix(ctx.getMatrix() * LookAt(org, _end, ctx.getAppData().m_worldUp));
     ctx.begin(PrimitiveMode_LineLoop);
     // yz silhoette + cap bases
     for (int i = 0; i <= detail2; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)detail2) - HalfPi;
-        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(circle[i].y, -circle[i].x, 0.0f) * _radius);
     }
     for (int i = 0; i < _detail; ++i)
     {
-        float rad = Pi * ((float)i / (float)_detail) + Pi;
-        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(0.0f, cosf(rad), sinf(rad)) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(0.0f, circle[i + _detail].x, circle[i + _detail].y) * _radius);
     }
     for (int i = 0; i < _detail; ++i)
     {
-        float rad = Pi * ((float)i / (float)_detail);
-        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(0.0f, cosf(rad), sinf(rad)) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(0.0f, circle[i].x, circle[i].y) * _radius);
     }
     for (int i = 0; i <= detail2; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)detail2) - HalfPi;
-        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(circle[i].y, -circle[i].x, 0.0f) * _radius);
     }
     ctx.end();
     ctx.begin(PrimitiveMode_LineLoop);
     // xz silhoette
     for (int i = 0; i < _detail; ++i)
     {
-        float rad = Pi * ((float)i / (float)_detail) + Pi;
-        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(cosf(rad), 0.0f, sinf(rad)) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(circle[i + _detail].x, 0.0f, circle[i + _detail].y) * _radius);
     }
     for (int i = 0; i < _detail; ++i)
     {
-        float rad = Pi * ((float)i / (float)_detail);
-        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(cosf(rad), 0.0f, sinf(rad)) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(circle[i].x, 0.0f, circle[i].y) * _radius);
     }
     ctx.end();
     ctx.popMatrix();
@@ -547,28 +696,31 @@ void Im3d::DrawPrism(const Vec3 &_start, const Vec3 &_end, float _radius, int _s
         return;
     }
 #endif
+    if (CullShape(ctx, (_start + _end) * 0.5f, Length(_end - _start) * 0.5f + _radius))
+    {
+        return;
+    }
 
     Vec3 org = _start + (_end - _start) * 0.5f;
     float ln = Length(_end - _start) * 0.5f;
+    // angles are offset by -HalfPi, cos/sin are (sin, -cos) of the unit circle angle
+    const Vec2 *circle = ctx.getUnitCircle(_sides);
     ctx.pushMatrix(ctx.getMatrix() * LookAt(org, _end, ctx.getAppData().m_worldUp));
     ctx.begin(PrimitiveMode_LineLoop);
     for (int i = 0; i <= _sides; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)_sides) - HalfPi;
-        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(circle[i].y, -circle[i].x, 0.0f) * _radius);
     }
     for (int i = 0; i <= _sides; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)_sides) - HalfPi;
-        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(circle[i].y, -circle[i].x, 0.0f) * _radius);
     }
     ctx.end();
     ctx.begin(PrimitiveMode_Lines);
     for (int i = 0; i <= _sides; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)_sides) - HalfPi;
-        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
-        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(cosf(rad), sinf(rad), 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, -ln) + Vec3(circle[i].y, -circle[i].x, 0.0f) * _radius);
+        ctx.vertex(Vec3(0.0f, 0.0f, ln) + Vec3(circle[i].y, -circle[i].x, 0.0f) * _radius);
     }
     ctx.end();
     ctx.popMatrix();
@@ -599,6 +751,225 @@ void Im3d::DrawArrow(const Vec3 &_start, const Vec3 &_end, float _headLength, fl
     ctx.end();
 }
 
+// # shapes culled and written per reserveVertices() call by DrawSpheres(), DrawAlignedBoxes(), DrawArrows().
+static const U32 kShapeBatchSize = 256;
+
+void Im3d::DrawSpheres(const Vec3 *_origins, const float *_radii, const Color *_colors, U32 _count, int _detail)
+{
+    Context &ctx = GetContext();
+    if (!ctx.getCullScopeVisible())
+    {
+        return;
+    }
+
+    const float size = ctx.getSize();
+    const Color color = ctx.getColor();
+    int detail[kShapeBatchSize];
+    for (U32 base = 0; base < _count; base += kShapeBatchSize)
+    {
+        const U32 count = _count - base < kShapeBatchSize ? _count - base : kShapeBatchSize;
+        const Vec3 *origins = _origins + base;
+        const float *radii = _radii + base;
+
+        // cull + LOD, detail = 0 for culled spheres
+        U32 vertexCount = 0;
+        for (U32 i = 0; i < count; ++i)
+        {
+            detail[i] = 0;
+#if IM3D_CULL_PRIMITIVES
+            if (!ctx.isVisible(origins[i], radii[i]))
+            {
+                continue;
+            }
+#endif
+            ctx.pushColor(_colors ? _colors[base + i] : color); // for the point drawn by CullShape()
+            const bool culled = CullShape(ctx, origins[i], radii[i]);
+            ctx.popColor();
+            if (culled)
+            {
+                continue;
+            }
+            detail[i] = _detail < 0 ? ctx.estimateLevelOfDetail(origins[i], radii[i], 8, 48) : _detail;
+            detail[i] = Max(detail[i], 3);
+            vertexCount += detail[i] * 6; // 3 circles, 2 vertices per segment
+        }
+        if (vertexCount == 0)
+        {
+            continue;
+        }
+
+        // xy, xz, yz circles as per DrawSphere()
+        VertexData *vd = ctx.reserveVertices(PrimitiveMode_Lines, vertexCount);
+        for (U32 i = 0; i < count; ++i)
+        {
+            if (detail[i] == 0)
+            {
+                continue;
+            }
+            const Vec2 *circle = ctx.getUnitCircle(detail[i]);
+            const Vec3 &o = origins[i];
+            const float r = radii[i];
+            const Color c = _colors ? _colors[base + i] : color;
+            for (int j = 0; j < detail[i]; ++j)
+            {
+                const Vec2 &p0 = circle[j];
+                const Vec2 &p1 = circle[j + 1 == detail[i] ? 0 : j + 1];
+                vd[0] = VertexData(Vec3(p0.x * r + o.x, p0.y * r + o.y, o.z), size, c);
+                vd[1] = VertexData(Vec3(p1.x * r + o.x, p1.y * r + o.y, o.z), size, c);
+                vd[2] = VertexData(Vec3(p0.x * r + o.x, o.y, p0.y * r + o.z), size, c);
+                vd[3] = VertexData(Vec3(p1.x * r + o.x, o.y, p1.y * r + o.z), size, c);
+                vd[4] = VertexData(Vec3(o.x, p0.x * r + o.y, p0.y * r + o.z), size, c);
+                vd[5] = VertexData(Vec3(o.x, p1.x * r + o.y, p1.y * r + o.z), size, c);
+                vd += 6;
+            }
+        }
+        ctx.commitVertices();
+    }
+}
+void Im3d::DrawAlignedBoxes(const Vec3 *_mins, const Vec3 *_maxs, const Color *_colors, U32 _count)
+{
+    Context &ctx = GetContext();
+    if (!ctx.getCullScopeVisible())
+    {
+        return;
+    }
+
+    const float size = ctx.getSize();
+    const Color color = ctx.getColor();
+    bool visible[kShapeBatchSize];
+    for (U32 base = 0; base < _count; base += kShapeBatchSize)
+    {
+        const U32 count = _count - base < kShapeBatchSize ? _count - base : kShapeBatchSize;
+        const Vec3 *mins = _mins + base;
+        const Vec3 *maxs = _maxs + base;
+
+        U32 visibleCount = 0;
+        for (U32 i = 0; i < count; ++i)
+        {
+#if IM3D_CULL_PRIMITIVES
+            visible[i] = ctx.isVisible(mins[i], maxs[i]);
+#else
+            visible[i] = true;
+#endif
+            if (visible[i])
+            {
+                ctx.pushColor(_colors ? _colors[base + i] : color); // for the point drawn by CullShape()
+                visible[i] = !CullShape(ctx, (mins[i] + maxs[i]) * 0.5f, Length(maxs[i] - mins[i]) * 0.5f);
+                ctx.popColor();
+            }
+            visibleCount += visible[i] ? 1 : 0;
+        }
+        if (visibleCount == 0)
+        {
+            continue;
+        }
+
+        // 12 edges as per DrawAlignedBox()
+        VertexData *vd = ctx.reserveVertices(PrimitiveMode_Lines, visibleCount * 24);
+        for (U32 i = 0; i < count; ++i)
+        {
+            if (!visible[i])
+            {
+                continue;
+            }
+            const Vec3 &a = mins[i];
+            const Vec3 &b = maxs[i];
+            const Color c = _colors ? _colors[base + i] : color;
+            const Vec3 corners[8] =
+                {
+                    Vec3(a.x, a.y, a.z), Vec3(b.x, a.y, a.z), Vec3(b.x, a.y, b.z), Vec3(a.x, a.y, b.z),
+                    Vec3(a.x, b.y, a.z), Vec3(b.x, b.y, a.z), Vec3(b.x, b.y, b.z), Vec3(a.x, b.y, b.z)};
+            static const int kEdges[24] =
+                {
+                    0, 1, 1, 2, 2, 3, 3, 0, // min y
+                    4, 5, 5, 6, 6, 7, 7, 4, // max y
+                    0, 4, 1, 5, 3, 7, 2, 6  // verticals
+                };
+            for (int j = 0; j < 24; ++j)
+            {
+                vd[j] = VertexData(corners[kEdges[j]], size, c);
+            }
+            vd += 24;
+        }
+        ctx.commitVertices();
+    }
+}
+void Im3d::DrawArrows(const Vec3 *_starts, const Vec3 *_ends, const Color *_colors, U32 _count, float _headLength, float _headThickness)
+{
+    Context &ctx = GetContext();
+    if (!ctx.getCullScopeVisible())
+    {
+        return;
+    }
+
+    const float size = ctx.getSize();
+    const Color color = ctx.getColor();
+    if (_headThickness < 0.0f)
+    {
+        _headThickness = size * 2.0f;
+    }
+#if IM3D_CULL_PRIMITIVES
+    // half the widest line of the arrow in pixels: the shaft, the head or the tip (see DrawArrow())
+    const float halfThickness = Max(Max(size, _headThickness), 2.0f) * 0.5f;
+#endif
+    bool visible[kShapeBatchSize];
+    for (U32 base = 0; base < _count; base += kShapeBatchSize)
+    {
+        const U32 count = _count - base < kShapeBatchSize ? _count - base : kShapeBatchSize;
+        const Vec3 *starts = _starts + base;
+        const Vec3 *ends = _ends + base;
+
+        // DrawArrow() is culled per primitive by end(), test each arrow's bounds (padded by the real line thickness rather than
+        // end()'s conservative 1 unit, such that arrows just outside the frustum are skipped before writing their vertices)
+        U32 visibleCount = 0;
+        for (U32 i = 0; i < count; ++i)
+        {
+#if IM3D_CULL_PRIMITIVES
+            // the head lies between start and end; a pixel's world size grows with distance, so the widest point is at either end
+            const Vec3 pad = Vec3(Max(ctx.pixelsToWorldSize(starts[i], halfThickness), ctx.pixelsToWorldSize(ends[i], halfThickness)));
+            visible[i] = ctx.isVisible(Min(starts[i], ends[i]) - pad, Max(starts[i], ends[i]) + pad);
+#else
+            visible[i] = true;
+#endif
+            const Vec3 center = (starts[i] + ends[i]) * 0.5f;
+            const float radius = Length(ends[i] - starts[i]) * 0.5f;
+            visible[i] = visible[i] && !ctx.isBelowMinPixelSize(center, radius) && !ctx.isOccluded(center, radius);
+            visibleCount += visible[i] ? 1 : 0;
+        }
+        if (visibleCount == 0)
+        {
+            continue;
+        }
+
+        VertexData *vd = ctx.reserveVertices(PrimitiveMode_Lines, visibleCount * 4);
+        for (U32 i = 0; i < count; ++i)
+        {
+            if (!visible[i])
+            {
+                continue;
+            }
+            // as per DrawArrow()
+            Vec3 dir = ends[i] - starts[i];
+            float dirlen = Length(dir);
+            float headLength = _headLength;
+            if (headLength < 0.0f)
+            {
+                headLength = Min(dirlen / 2.0f, ctx.pixelsToWorldSize(ends[i], _headThickness * 2.0f));
+            }
+            dir = dir / dirlen;
+
+            const Vec3 head = ends[i] - dir * headLength;
+            const Color c = _colors ? _colors[base + i] : color;
+            vd[0] = VertexData(starts[i], size, c);
+            vd[1] = VertexData(head, size, c);
+            vd[2] = VertexData(head, _headThickness, c);
+            vd[3] = VertexData(ends[i], 2.0f, c); // see DrawArrow()
+            vd += 4;
+        }
+        ctx.commitVertices();
+    }
+}
+
 static constexpr U32 kFnv1aPrime32 = 0x01000193u;
 static U32 Hash(const char *_buf, int _buflen, U32 _base)
 {
@@ -1273,12 +1644,31 @@ static void AlignedFree(void *_ptr_)
     IM3D_FREE(mem);
 }
 
+namespace
+{
+void *DefaultAlloc(size_t _size, size_t _align, void *)
+{
+    return AlignedMalloc(_size, _align);
+}
+void DefaultFree(void *_ptr, void *)
+{
+    AlignedFree(_ptr);
+}
+const Allocator s_defaultAllocator = {DefaultAlloc, DefaultFree, nullptr};
+
+inline const Allocator &GetAllocator(const Allocator *_allocator)
+{
+    return _allocator ? *_allocator : s_defaultAllocator;
+}
+} // namespace
+
 template <typename T>
 Vector<T>::~Vector()
 {
     if (m_data)
     {
-        AlignedFree(m_data);
+        const Allocator &allocator = GetAllocator(m_allocator);
+        allocator.m_free(m_data, allocator.m_userData);
         m_data = 0;
     }
 }
@@ -1304,12 +1694,14 @@ void Vector<T>::reserve(U32 _capacity)
     {
         return;
     }
-    T *data = (T *)AlignedMalloc(sizeof(T) * _capacity, alignof(T));
+    const Allocator &allocator = GetAllocator(m_allocator);
+    T *data = (T *)allocator.m_alloc(sizeof(T) * _capacity, alignof(T), allocator.m_userData);
     if (m_data)
     {
-        memcpy(data, m_data, sizeof(T) * m_size);
-        AlignedFree(m_data);
-        ;
+        // elements are relocated bitwise, T must be trivially relocatable; this includes Vector itself (the per-layer tables are
+        // Vector<Vector<T>>), the void* casts mark this as intended for -Wclass-memaccess
+        memcpy((void *)data, (const void *)m_data, sizeof(T) * m_size);
+        allocator.m_free(m_data, allocator.m_userData);
     }
     m_data = data;
     m_capacity = _capacity;
@@ -1332,12 +1724,15 @@ void Vector<T>::swap(Vector<T> &_a_, Vector<T> &_b_)
     T *data = _a_.m_data;
     U32 capacity = _a_.m_capacity;
     U32 size = _a_.m_size;
+    const Allocator *allocator = _a_.m_allocator;
     _a_.m_data = _b_.m_data;
     _a_.m_capacity = _b_.m_capacity;
     _a_.m_size = _b_.m_size;
+    _a_.m_allocator = _b_.m_allocator;
     _b_.m_data = data;
     _b_.m_capacity = capacity;
     _b_.m_size = size;
+    _b_.m_allocator = allocator;
 }
 
 template class Vector<bool>;
@@ -1350,383 +1745,2072 @@ template class Vector<DrawList>;
 
 /*******************************************************************************
 
-                                 Context
+                                  FrameArena
 
 *******************************************************************************/
 
-static Context g_DefaultContext;
-IM3D_THREAD_LOCAL Context *Im3d::internal::g_CurrentContext = &g_DefaultContext;
+namespace
+{
+const size_t kFrameArenaMinChunkSize = 64 * 1024;
+const size_t kFrameArenaChunkAlign = 64;
 
-void Context::begin(PrimitiveMode _mode)
+void *FrameArenaAlloc(size_t _size, size_t _align, void *_userData)
 {
-    IM3D_ASSERT(!m_endFrameCalled);                // Begin*() called after EndFrame() but before NewFrame(), or forgot to call NewFrame()
-    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // forgot to call End()
-    m_primMode = _mode;
-    m_vertCountThisPrim = 0;
-    switch (m_primMode)
-    {
-    case PrimitiveMode_Points:
-        m_primType = DrawPrimitive_Points;
-        break;
-    case PrimitiveMode_Lines:
-    case PrimitiveMode_LineStrip:
-    case PrimitiveMode_LineLoop:
-        m_primType = DrawPrimitive_Lines;
-        break;
-    case PrimitiveMode_Triangles:
-    case PrimitiveMode_TriangleStrip:
-        m_primType = DrawPrimitive_Triangles;
-        break;
-    default:
-        break;
-    };
-    m_firstVertThisPrim = getCurrentVertexList()->size();
+    return ((FrameArena *)_userData)->allocate(_size, _align);
+}
+void FrameArenaFree(void *, void *)
+{
+    // memory is reclaimed by FrameArena::reset()
 }
+} // namespace
 
-void Context::end()
+FrameArena::~FrameArena()
 {
-    IM3D_ASSERT(m_primMode != PrimitiveMode_None); // End() called without Begin*()
-    if (m_vertCountThisPrim > 0)
-    {
-        VertexList *vertexList = getCurrentVertexList();
-        switch (m_primMode)
-        {
-        case PrimitiveMode_Points:
-            break;
-        case PrimitiveMode_Lines:
-            IM3D_ASSERT(m_vertCountThisPrim % 2 == 0);
-            break;
-        case PrimitiveMode_LineStrip:
-            IM3D_ASSERT(m_vertCountThisPrim > 1);
-            break;
-        case PrimitiveMode_LineLoop:
-            IM3D_ASSERT(m_vertCountThisPrim > 1);
-            vertexList->push_back(vertexList->back());
-            vertexList->push_back((*vertexList)[m_firstVertThisPrim]);
-            break;
-        case PrimitiveMode_Triangles:
-            IM3D_ASSERT(m_vertCountThisPrim % 3 == 0);
-            break;
-        case PrimitiveMode_TriangleStrip:
-            IM3D_ASSERT(m_vertCountThisPrim >= 3);
-            break;
-        default:
-            break;
-        };
-#if IM3D_CULL_PRIMITIVES
-        // \hack force the bounds to be slightly conservative to account for point/line size
-        m_minVertThisPrim = m_minVertThisPrim - Vec3(1.0f);
-        m_maxVertThisPrim = m_maxVertThisPrim + Vec3(1.0f);
-        if (!isVisible(m_minVertThisPrim, m_maxVertThisPrim))
-        {
-            vertexList->resize(m_firstVertThisPrim, VertexData());
-        }
-#endif
-    }
-    m_primMode = PrimitiveMode_None;
-    m_primType = DrawPrimitive_Count;
-#if IM3D_CULL_PRIMITIVES
-    // \debug draw primitive BBs
-    //if (m_enableCulling) {
-    //	m_enableCulling = false;
-    //	pushColor(Im3d::Color_Magenta);
-    //	pushSize(1.0f);
-    //	pushMatrix(Mat4(1.0f));
-    //	DrawAlignedBox(m_minVertThisPrim, m_maxVertThisPrim);
-    //	popMatrix();
-    //	popColor();
-    //	popSize();
-    //	m_enableCulling = true;
-    //}
-#endif
+    freeChunks();
 }
 
-void Context::vertex(const Vec3 &_position, float _size, Color _color)
+void FrameArena::init(const Allocator *_parent)
 {
-    IM3D_ASSERT(m_primMode != PrimitiveMode_None); // Vertex() called without Begin*()
+    IM3D_ASSERT(m_parent == nullptr); // init() called multiple times
+    m_parent = _parent;
+    m_allocator.m_alloc = FrameArenaAlloc;
+    m_allocator.m_free = FrameArenaFree;
+    m_allocator.m_userData = this;
+}
 
-    VertexData vd(_position, _size, _color);
-    if (m_matrixStack.size() > 1)
-    { // optim, skip the matrix multiplication when the stack size is 1
-        vd.m_positionSize = Vec4(m_matrixStack.back() * _position, _size);
+void *FrameArena::allocate(size_t _size, size_t _align)
+{
+    IM3D_ASSERT(m_parent); // init() not called
+    IM3D_ASSERT((_align & (_align - 1)) == 0);
+    size_t ret = ((size_t)m_top + (_align - 1)) & ~(_align - 1);
+    if (m_chunks == nullptr || ret + _size > (size_t)m_end)
+    {
+        // each new chunk is at least the size of all previous chunks, this bounds the chunk count in the first frames
+        size_t chunkSize = _size + _align;
+        chunkSize = chunkSize < m_capacityBytes ? m_capacityBytes : chunkSize;
+        chunkSize = chunkSize < kFrameArenaMinChunkSize ? kFrameArenaMinChunkSize : chunkSize;
+        addChunk(chunkSize);
+        ret = ((size_t)m_top + (_align - 1)) & ~(_align - 1);
     }
-    vd.m_color.setA(vd.m_color.getA() * m_alphaStack.back());
+    m_usedBytes += (ret + _size) - (size_t)m_top;
+    m_top = (char *)(ret + _size);
+    return (void *)ret;
+}
 
-#if IM3D_CULL_PRIMITIVES
-    Vec3 p = Vec3(vd.m_positionSize);
-    if (m_vertCountThisPrim == 0)
-    { // p is the first vertex
-        m_minVertThisPrim = m_maxVertThisPrim = p;
+void FrameArena::reset()
+{
+    if (m_chunkCount > 1)
+    {
+        // last frame overflowed the first chunk, replace all chunks with a single chunk (+50% as per Vector)
+        size_t chunkSize = m_usedBytes + m_usedBytes / 2;
+        freeChunks();
+        addChunk(chunkSize < kFrameArenaMinChunkSize ? kFrameArenaMinChunkSize : chunkSize);
     }
-    else
+    else if (m_chunks)
     {
-        m_minVertThisPrim = Min(m_minVertThisPrim, p);
-        m_maxVertThisPrim = Max(m_maxVertThisPrim, p);
+        m_top = (char *)(m_chunks + 1);
     }
-#endif
-
-    VertexList *vertexList = getCurrentVertexList();
-    switch (m_primMode)
-    {
-    case PrimitiveMode_Points:
-    case PrimitiveMode_Lines:
-    case PrimitiveMode_Triangles:
-        vertexList->push_back(vd);
-        break;
-    case PrimitiveMode_LineStrip:
-    case PrimitiveMode_LineLoop:
-        if (m_vertCountThisPrim >= 2)
-        {
-            vertexList->push_back(vertexList->back());
-            ++m_vertCountThisPrim;
-        }
-        vertexList->push_back(vd);
-        break;
-    case PrimitiveMode_TriangleStrip:
-        if (m_vertCountThisPrim >= 3)
-        {
-            vertexList->push_back(*(vertexList->end() - 2));
-            vertexList->push_back(*(vertexList->end() - 2));
-            m_vertCountThisPrim += 2;
-        }
-        vertexList->push_back(vd);
-        break;
-    default:
-        break;
-    };
-    ++m_vertCountThisPrim;
+    m_usedBytes = 0;
+}
 
-#if 0
-	 // per-vertex primitive culling; this method is generally too expensive to be practical (and can't cull line loops).
-
-	 // check if the primitive was visible and rewind vertex data if not
-		switch (m_primMode) {
-			case PrimitiveMode_Points:
-				if (!isVisible(&vertexList->back(), DrawPrimitive_Points)) {
-					vertexList->pop_back();
-					--m_vertCountThisPrim;
-				}
-				break;
-			case PrimitiveMode_LineLoop:
-				break; // can't cull line loops; end() may add an invalid line if any vertices are culled
-			case PrimitiveMode_Lines:
-			case PrimitiveMode_LineStrip:
-				if (m_vertCountThisPrim % 2 == 0) {
-					if (!isVisible(&vertexList->back() - 1, DrawPrimitive_Lines)) {
-						for (int i = 0; i < 2; ++i) {
-							vertexList->pop_back();
-							--m_vertCountThisPrim;
-						}
-					}
-				}
-				break;
-			case PrimitiveMode_Triangles:
-			case PrimitiveMode_TriangleStrip:
-				if (m_vertCountThisPrim % 3 == 0) {
-					if (!isVisible(&vertexList->back() - 2, DrawPrimitive_Triangles)) {
-						for (int i = 0; i < 3; ++i) {
-							vertexList->pop_back();
-							--m_vertCountThisPrim;
-						}
-					}
-				}
-				break;
-			default:
-				break;
-		};
-#endif
+void FrameArena::addChunk(size_t _size)
+{
+    Chunk *chunk = (Chunk *)m_parent->m_alloc(sizeof(Chunk) + _size, kFrameArenaChunkAlign, m_parent->m_userData);
+    IM3D_ASSERT(chunk);
+    chunk->m_next = m_chunks;
+    chunk->m_size = _size;
+    m_chunks = chunk;
+    m_top = (char *)(chunk + 1);
+    m_end = m_top + _size;
+    m_capacityBytes += _size;
+    ++m_chunkCount;
 }
 
-void Context::reset()
+void FrameArena::freeChunks()
 {
-    // all state stacks should be default here, else there was a mismatched Push*()/Pop*()
-    IM3D_ASSERT(m_colorStack.size() == 1);
-    IM3D_ASSERT(m_alphaStack.size() == 1);
-    IM3D_ASSERT(m_sizeStack.size() == 1);
-    IM3D_ASSERT(m_enableSortingStack.size() == 1);
-    IM3D_ASSERT(m_layerIdStack.size() == 1);
-    IM3D_ASSERT(m_matrixStack.size() == 1);
-    IM3D_ASSERT(m_idStack.size() == 1);
+    while (m_chunks)
+    {
+        Chunk *next = m_chunks->m_next;
+        m_parent->m_free(m_chunks, m_parent->m_userData);
+        m_chunks = next;
+    }
+    m_top = m_end = nullptr;
+    m_capacityBytes = 0;
+    m_chunkCount = 0;
+}
 
-    IM3D_ASSERT(m_primMode == PrimitiveMode_None);
-    m_primMode = PrimitiveMode_None;
-    m_primType = DrawPrimitive_Count;
+/*******************************************************************************
 
-    for (U32 i = 0; i < m_vertexData[0].size(); ++i)
+                              Vertex transform
+
+*******************************************************************************/
+
+namespace
+{
+// Apply _matrix (if not null) and _alpha to _count vertices in place, as per Context::vertex().
+// All kernels produce identical output: same operation order as the scalar path, no FMA, truncating float -> int conversion.
+typedef void(TransformVerticesFunc)(VertexData *_vertices_, U32 _count, const Mat4 *_matrix, float _alpha);
+
+void TransformVertices_Scalar(VertexData *_vertices_, U32 _count, const Mat4 *_matrix, float _alpha)
+{
+    for (U32 i = 0; i < _count; ++i)
     {
-        m_vertexData[0][i]->clear();
-        m_vertexData[1][i]->clear();
+        VertexData &vd = _vertices_[i];
+        if (_matrix)
+        {
+            vd.m_positionSize = Vec4(*_matrix * Vec3(vd.m_positionSize), vd.m_positionSize.w);
+        }
+        vd.m_color.setA(vd.m_color.getA() * _alpha);
     }
-    m_drawLists.clear();
-    m_sortCalled = false;
-    m_endFrameCalled = false;
+}
 
-    m_appData.m_viewDirection = Normalize(m_appData.m_viewDirection);
+#if IM3D_SIMD
+inline __m128i LoadColors4(const VertexData *_vertices)
+{
+    // \note _mm_setr_epi32() may be built via the stack (store forwarding stall), movd + unpack instead
+    return _mm_unpacklo_epi64(
+        _mm_unpacklo_epi32(_mm_cvtsi32_si128((int)_vertices[0].m_color.v), _mm_cvtsi32_si128((int)_vertices[1].m_color.v)),
+        _mm_unpacklo_epi32(_mm_cvtsi32_si128((int)_vertices[2].m_color.v), _mm_cvtsi32_si128((int)_vertices[3].m_color.v)));
+}
 
-    // copy keydown array internally so that we can make a delta to detect key presses
-    memcpy(m_keyDownPrev, m_keyDownCurr, Key_Count);       // \todo avoid this copy, use an index
-    memcpy(m_keyDownCurr, m_appData.m_keyDown, Key_Count); // must copy in case m_keyDown is updated after reset (e.g. by an app callback)
+void TransformVertices_SSE(VertexData *_vertices_, U32 _count, const Mat4 *_matrix, float _alpha)
+{
+    const Mat4 &m = _matrix ? *_matrix : Mat4(1.0f);
+    const __m128 m00 = _mm_set1_ps(m(0, 0)), m01 = _mm_set1_ps(m(0, 1)), m02 = _mm_set1_ps(m(0, 2)), m03 = _mm_set1_ps(m(0, 3));
+    const __m128 m10 = _mm_set1_ps(m(1, 0)), m11 = _mm_set1_ps(m(1, 1)), m12 = _mm_set1_ps(m(1, 2)), m13 = _mm_set1_ps(m(1, 3));
+    const __m128 m20 = _mm_set1_ps(m(2, 0)), m21 = _mm_set1_ps(m(2, 1)), m22 = _mm_set1_ps(m(2, 2)), m23 = _mm_set1_ps(m(2, 3));
+    const __m128 alpha = _mm_set1_ps(_alpha);
+    const __m128 k255 = _mm_set1_ps(255.0f);
+    const __m128i maskA = _mm_set1_epi32(0xff);
 
-    // process cull frustum
-    m_cullFrustumCount = 0;
-    for (int i = 0; i < FrustumPlane_Count; ++i)
+    U32 i = 0;
+    for (; i + 4 <= _count; i += 4)
     {
-        const Vec4 &plane = m_appData.m_cullFrustum[i];
-        if (m_appData.m_projOrtho && i == FrustumPlane_Near)
-        { // skip near plane if perspective
-            continue;
+        VertexData *vd = _vertices_ + i;
+        if (_matrix)
+        {
+            __m128 x = _mm_loadu_ps(&vd[0].m_positionSize.x);
+            __m128 y = _mm_loadu_ps(&vd[1].m_positionSize.x);
+            __m128 z = _mm_loadu_ps(&vd[2].m_positionSize.x);
+            __m128 w = _mm_loadu_ps(&vd[3].m_positionSize.x);
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            __m128 tx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_mul_ps(m02, z)), m03);
+            __m128 ty = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m12, z)), m13);
+            __m128 tz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_mul_ps(m22, z)), m23);
+            _MM_TRANSPOSE4_PS(tx, ty, tz, w);
+            _mm_storeu_ps(&vd[0].m_positionSize.x, tx);
+            _mm_storeu_ps(&vd[1].m_positionSize.x, ty);
+            _mm_storeu_ps(&vd[2].m_positionSize.x, tz);
+            _mm_storeu_ps(&vd[3].m_positionSize.x, w);
         }
-        if (std::isinf(plane.w))
-        { // may be the case e.g. for the far plane if projection is infinite
-            continue;
+        if (_alpha != 1.0f)
+        {
+            __m128i c = LoadColors4(vd);
+            __m128 a = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(c, maskA)), k255);
+            a = _mm_mul_ps(_mm_mul_ps(a, alpha), k255);
+            c = _mm_or_si128(_mm_andnot_si128(maskA, c), _mm_cvttps_epi32(a));
+            alignas(16) U32 colors[4];
+            _mm_store_si128((__m128i *)colors, c);
+            for (int j = 0; j < 4; ++j)
+            {
+                vd[j].m_color.v = colors[j];
+            }
         }
-        m_cullFrustum[m_cullFrustumCount++] = plane;
     }
+    TransformVertices_Scalar(_vertices_ + i, _count - i, _matrix, _alpha);
+}
 
-    // update gizmo modes
-    if (wasKeyPressed(Action_GizmoTranslation))
-    {
-        m_gizmoMode = GizmoMode_Translation;
-        resetId();
-    }
-    else if (wasKeyPressed(Action_GizmoRotation))
+IM3D_TARGET_AVX2 void TransformVertices_AVX2(VertexData *_vertices_, U32 _count, const Mat4 *_matrix, float _alpha)
+{
+    const Mat4 &m = _matrix ? *_matrix : Mat4(1.0f);
+    const __m256 m00 = _mm256_set1_ps(m(0, 0)), m01 = _mm256_set1_ps(m(0, 1)), m02 = _mm256_set1_ps(m(0, 2)), m03 = _mm256_set1_ps(m(0, 3));
+    const __m256 m10 = _mm256_set1_ps(m(1, 0)), m11 = _mm256_set1_ps(m(1, 1)), m12 = _mm256_set1_ps(m(1, 2)), m13 = _mm256_set1_ps(m(1, 3));
+    const __m256 m20 = _mm256_set1_ps(m(2, 0)), m21 = _mm256_set1_ps(m(2, 1)), m22 = _mm256_set1_ps(m(2, 2)), m23 = _mm256_set1_ps(m(2, 3));
+    const __m256 alpha = _mm256_set1_ps(_alpha);
+    const __m256 k255 = _mm256_set1_ps(255.0f);
+    const __m256i maskA = _mm256_set1_epi32(0xff);
+
+    U32 i = 0;
+    for (; i + 8 <= _count; i += 8)
     {
-        m_gizmoMode = GizmoMode_Rotation;
-        resetId();
+        VertexData *vd = _vertices_ + i;
+        if (_matrix)
+        {
+            // vertices i, i+4 share a row, transpose each 128-bit lane independently
+            __m256 r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&vd[0].m_positionSize.x)), _mm_loadu_ps(&vd[4].m_positionSize.x), 1);
+            __m256 r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&vd[1].m_positionSize.x)), _mm_loadu_ps(&vd[5].m_positionSize.x), 1);
+            __m256 r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&vd[2].m_positionSize.x)), _mm_loadu_ps(&vd[6].m_positionSize.x), 1);
+            __m256 r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&vd[3].m_positionSize.x)), _mm_loadu_ps(&vd[7].m_positionSize.x), 1);
+            __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+            __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+            __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+            __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+            __m256 x = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 y = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 z = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 w = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 tx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, x), _mm256_mul_ps(m01, y)), _mm256_mul_ps(m02, z)), m03);
+            __m256 ty = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m10, x), _mm256_mul_ps(m11, y)), _mm256_mul_ps(m12, z)), m13);
+            __m256 tz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m20, x), _mm256_mul_ps(m21, y)), _mm256_mul_ps(m22, z)), m23);
+            t0 = _mm256_unpacklo_ps(tx, ty);
+            t1 = _mm256_unpacklo_ps(tz, w);
+            t2 = _mm256_unpackhi_ps(tx, ty);
+            t3 = _mm256_unpackhi_ps(tz, w);
+            r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+            r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+            r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+            r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+            _mm_storeu_ps(&vd[0].m_positionSize.x, _mm256_castps256_ps128(r0));
+            _mm_storeu_ps(&vd[1].m_positionSize.x, _mm256_castps256_ps128(r1));
+            _mm_storeu_ps(&vd[2].m_positionSize.x, _mm256_castps256_ps128(r2));
+            _mm_storeu_ps(&vd[3].m_positionSize.x, _mm256_castps256_ps128(r3));
+            _mm_storeu_ps(&vd[4].m_positionSize.x, _mm256_extractf128_ps(r0, 1));
+            _mm_storeu_ps(&vd[5].m_positionSize.x, _mm256_extractf128_ps(r1, 1));
+            _mm_storeu_ps(&vd[6].m_positionSize.x, _mm256_extractf128_ps(r2, 1));
+            _mm_storeu_ps(&vd[7].m_positionSize.x, _mm256_extractf128_ps(r3, 1));
+        }
+        if (_alpha != 1.0f)
+        {
+            __m256i c = _mm256_inserti128_si256(_mm256_castsi128_si256(LoadColors4(vd)), LoadColors4(vd + 4), 1); // faster than a gather on most cpus
+            __m256 a = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(c, maskA)), k255);
+            a = _mm256_mul_ps(_mm256_mul_ps(a, alpha), k255);
+            c = _mm256_or_si256(_mm256_andnot_si256(maskA, c), _mm256_cvttps_epi32(a));
+            alignas(32) U32 colors[8];
+            _mm256_store_si256((__m256i *)colors, c);
+            for (int j = 0; j < 8; ++j)
+            {
+                vd[j].m_color.v = colors[j];
+            }
+        }
     }
-    else if (wasKeyPressed(Action_GizmoScale))
+    TransformVertices_SSE(_vertices_ + i, _count - i, _matrix, _alpha);
+}
+
+bool CpuSupportsAVX2()
+{
+#if defined(IM3D_COMPILER_MSVC)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
     {
-        m_gizmoMode = GizmoMode_Scale;
-        resetId();
+        return false;
     }
-    if (wasKeyPressed(Action_GizmoLocal))
+    __cpuid(info, 1);
+    const int osxsaveAvx = (1 << 27) | (1 << 28);
+    if ((info[2] & osxsaveAvx) != osxsaveAvx || (_xgetbv(0) & 6) != 6) // OS must save the YMM registers
     {
-        m_gizmoLocal = !m_gizmoLocal;
-        resetId();
+        return false;
     }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
 }
+#endif // IM3D_SIMD
 
-void Context::merge(const Context &_src)
+TransformVerticesFunc *SelectTransformVertices()
 {
-    IM3D_ASSERT(!m_endFrameCalled && !_src.m_endFrameCalled); // call MergeContexts() before calling EndFrame()
+#if IM3D_SIMD
+    return CpuSupportsAVX2() ? TransformVertices_AVX2 : TransformVertices_SSE;
+#else
+    return TransformVertices_Scalar;
+#endif
+}
 
-    // layer IDs
-    for (auto &id : _src.m_layerIdMap)
-    {
-        pushLayerId(id); // add a new layer if id doesn't alrady exist
-        popLayerId();
+void TransformVertices(VertexData *_vertices_, U32 _count, const Mat4 *_matrix, float _alpha)
+{
+    if (!_matrix && _alpha == 1.0f)
+    { // alpha * 1 is exact for all 8-bit values
+        return;
     }
+    static TransformVerticesFunc *s_transformVertices = SelectTransformVertices();
+    s_transformVertices(_vertices_, _count, _matrix, _alpha);
+}
+} // namespace
 
-    // vertex data
-    for (U32 i = 0; i < 2; ++i)
+/*******************************************************************************
+
+                              Primitive culling
+
+*******************************************************************************/
+
+#if IM3D_CULL_PRIMITIVES
+namespace
+{
+// Test _count boxes (SoA min x/y/z, max x/y/z in _bounds) against _planeCount planes, write the result to _visible_.
+// All kernels produce the same result as Context::isVisible(min, max): same operation order, no FMA.
+typedef void(CullBoxesFunc)(const float *const _bounds[6], U32 _count, const Vec4 *_planes, int _planeCount, bool *_visible_);
+
+void CullBoxes_Scalar(const float *const _bounds[6], U32 _count, const Vec4 *_planes, int _planeCount, bool *_visible_)
+{
+    for (U32 i = 0; i < _count; ++i)
     {
-        auto &vertexData = _src.m_vertexData[i];
-        for (U32 j = 0; j < vertexData.size(); ++j)
+        bool visible = true;
+        for (int j = 0; j < _planeCount && visible; ++j)
         {
-            // for each layer in _src, find the matching layer in this
-            Id layerId = _src.m_layerIdMap[j / DrawPrimitive_Count];
-            int layerIndex = findLayerIndex(layerId);
-            IM3D_ASSERT(layerIndex >= 0);
-            U32 k = j % DrawPrimitive_Count;
-            m_vertexData[i][layerIndex * DrawPrimitive_Count + k]->append(*vertexData[j]);
+            const Vec4 &plane = _planes[j];
+            float d =
+                Max(_bounds[0][i] * plane.x, _bounds[3][i] * plane.x) +
+                Max(_bounds[1][i] * plane.y, _bounds[4][i] * plane.y) +
+                Max(_bounds[2][i] * plane.z, _bounds[5][i] * plane.z) -
+                plane.w;
+            visible = !(d < 0.0f);
         }
+        _visible_[i] = visible;
     }
 }
 
-void Context::endFrame()
+#if IM3D_SIMD
+void CullBoxes_SSE(const float *const _bounds[6], U32 _count, const Vec4 *_planes, int _planeCount, bool *_visible_)
 {
-    IM3D_ASSERT(!m_endFrameCalled); // EndFrame() was called multiple times for this frame
-    m_endFrameCalled = true;
-
-    // draw unsorted primitives first
-    for (U32 i = 0; i < m_vertexData[0].size(); ++i)
+    __m128 planes[FrustumPlane_Count][4];
+    for (int j = 0; j < _planeCount; ++j)
     {
-        if (m_vertexData[0][i]->size() > 0)
-        {
-            DrawList dl;
-            dl.m_layerId = m_layerIdMap[i / DrawPrimitive_Count];
-            dl.m_primType = (DrawPrimitiveType)(i % DrawPrimitive_Count);
-            dl.m_vertexData = m_vertexData[0][i]->data();
-            dl.m_vertexCount = m_vertexData[0][i]->size();
-            m_drawLists.push_back(dl);
-        }
+        planes[j][0] = _mm_set1_ps(_planes[j].x);
+        planes[j][1] = _mm_set1_ps(_planes[j].y);
+        planes[j][2] = _mm_set1_ps(_planes[j].z);
+        planes[j][3] = _mm_set1_ps(_planes[j].w);
     }
+    const __m128 zero = _mm_setzero_ps();
 
-    // draw sorted primitives second
-    if (!m_sortCalled)
+    U32 i = 0;
+    for (; i + 4 <= _count; i += 4)
     {
-        sort();
+        const __m128 minX = _mm_loadu_ps(_bounds[0] + i), minY = _mm_loadu_ps(_bounds[1] + i), minZ = _mm_loadu_ps(_bounds[2] + i);
+        const __m128 maxX = _mm_loadu_ps(_bounds[3] + i), maxY = _mm_loadu_ps(_bounds[4] + i), maxZ = _mm_loadu_ps(_bounds[5] + i);
+        __m128 culled = zero;
+        for (int j = 0; j < _planeCount; ++j)
+        {
+            const __m128 *p = planes[j];
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_max_ps(_mm_mul_ps(minX, p[0]), _mm_mul_ps(maxX, p[0])),
+                    _mm_max_ps(_mm_mul_ps(minY, p[1]), _mm_mul_ps(maxY, p[1]))),
+                _mm_max_ps(_mm_mul_ps(minZ, p[2]), _mm_mul_ps(maxZ, p[2])));
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(_mm_sub_ps(d, p[3]), zero));
+        }
+        const int mask = _mm_movemask_ps(culled);
+        for (int k = 0; k < 4; ++k)
+        {
+            _visible_[i + k] = (mask & (1 << k)) == 0;
+        }
     }
+    const float *const tail[6] = {_bounds[0] + i, _bounds[1] + i, _bounds[2] + i, _bounds[3] + i, _bounds[4] + i, _bounds[5] + i};
+    CullBoxes_Scalar(tail, _count - i, _planes, _planeCount, _visible_ + i);
 }
 
-void Context::draw()
+IM3D_TARGET_AVX2 void CullBoxes_AVX2(const float *const _bounds[6], U32 _count, const Vec4 *_planes, int _planeCount, bool *_visible_)
 {
-    if (m_drawLists.empty())
+    __m256 planes[FrustumPlane_Count][4];
+    for (int j = 0; j < _planeCount; ++j)
     {
-        endFrame();
+        planes[j][0] = _mm256_set1_ps(_planes[j].x);
+        planes[j][1] = _mm256_set1_ps(_planes[j].y);
+        planes[j][2] = _mm256_set1_ps(_planes[j].z);
+        planes[j][3] = _mm256_set1_ps(_planes[j].w);
     }
+    const __m256 zero = _mm256_setzero_ps();
 
-    IM3D_ASSERT(m_appData.drawCallback);
-    for (auto &drawList : m_drawLists)
+    U32 i = 0;
+    for (; i + 8 <= _count; i += 8)
     {
-        m_appData.drawCallback(drawList);
+        const __m256 minX = _mm256_loadu_ps(_bounds[0] + i), minY = _mm256_loadu_ps(_bounds[1] + i), minZ = _mm256_loadu_ps(_bounds[2] + i);
+        const __m256 maxX = _mm256_loadu_ps(_bounds[3] + i), maxY = _mm256_loadu_ps(_bounds[4] + i), maxZ = _mm256_loadu_ps(_bounds[5] + i);
+        __m256 culled = zero;
+        for (int j = 0; j < _planeCount; ++j)
+        {
+            const __m256 *p = planes[j];
+            __m256 d = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_max_ps(_mm256_mul_ps(minX, p[0]), _mm256_mul_ps(maxX, p[0])),
+                    _mm256_max_ps(_mm256_mul_ps(minY, p[1]), _mm256_mul_ps(maxY, p[1]))),
+                _mm256_max_ps(_mm256_mul_ps(minZ, p[2]), _mm256_mul_ps(maxZ, p[2])));
+            culled = _mm256_or_ps(culled, _mm256_cmp_ps(_mm256_sub_ps(d, p[3]), zero, _CMP_LT_OQ));
+        }
+        const int mask = _mm256_movemask_ps(culled);
+        for (int k = 0; k < 8; ++k)
+        {
+            _visible_[i + k] = (mask & (1 << k)) == 0;
+        }
     }
+    const float *const tail[6] = {_bounds[0] + i, _bounds[1] + i, _bounds[2] + i, _bounds[3] + i, _bounds[4] + i, _bounds[5] + i};
+    CullBoxes_SSE(tail, _count - i, _planes, _planeCount, _visible_ + i);
 }
+#endif // IM3D_SIMD
 
-void Context::pushEnableSorting(bool _enable)
+void CullBoxes(const float *const _bounds[6], U32 _count, const Vec4 *_planes, int _planeCount, bool *_visible_)
 {
-    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change sort mode mid-primitive
-    m_vertexDataIndex = _enable ? 1 : 0;
-    m_enableSortingStack.push_back(_enable);
+#if IM3D_SIMD
+    static CullBoxesFunc *s_cullBoxes = CpuSupportsAVX2() ? CullBoxes_AVX2 : CullBoxes_SSE;
+#else
+    static CullBoxesFunc *s_cullBoxes = CullBoxes_Scalar;
+#endif
+    s_cullBoxes(_bounds, _count, _planes, _planeCount, _visible_);
 }
-void Context::popEnableSorting()
+
+// Read/write positions in a vertex/index list during Context::cullPrimitives().
+struct CullCursor
 {
-    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change sort mode mid-primitive
-    m_enableSortingStack.pop_back();
-    m_vertexDataIndex = m_enableSortingStack.back() ? 1 : 0;
-}
-void Context::setEnableSorting(bool _enable)
+    U32 m_vertexRead;
+    U32 m_vertexWrite;
+    U32 m_indexRead;
+    U32 m_indexWrite;
+};
+
+// Keep vertices [m_vertexRead, _vertexEnd) and indices [m_indexRead, _indexEnd), move them down to the write positions.
+// Indices refer to vertices in the same list, offset them by the number of vertices removed so far.
+template <typename VertexList, typename IndexList>
+void CullKeep(CullCursor &_cursor_, VertexList &_vertexData_, U32 _vertexEnd, IndexList *_indexData_, U32 _indexEnd)
 {
-    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change sort mode mid-primitive
-    m_vertexDataIndex = _enable ? 1 : 0;
-    m_enableSortingStack.back() = _enable;
+    const U32 removedVertices = _cursor_.m_vertexRead - _cursor_.m_vertexWrite;
+    const U32 vertexCount = _vertexEnd - _cursor_.m_vertexRead;
+    if (removedVertices > 0 && vertexCount > 0)
+    {
+        memmove(_vertexData_.data() + _cursor_.m_vertexWrite, _vertexData_.data() + _cursor_.m_vertexRead, sizeof(_vertexData_[0]) * vertexCount);
+    }
+    _cursor_.m_vertexWrite += vertexCount;
+    _cursor_.m_vertexRead = _vertexEnd;
+
+    if (_indexData_)
+    {
+        U32 *src = _indexData_->data() + _cursor_.m_indexRead;
+        U32 *dst = _indexData_->data() + _cursor_.m_indexWrite;
+        const U32 indexCount = _indexEnd - _cursor_.m_indexRead;
+        if (src != dst || removedVertices > 0)
+        {
+            for (U32 i = 0; i < indexCount; ++i)
+            {
+                dst[i] = src[i] - removedVertices;
+            }
+        }
+        _cursor_.m_indexWrite += indexCount;
+        _cursor_.m_indexRead = _indexEnd;
+    }
 }
+} // namespace
+#endif // IM3D_CULL_PRIMITIVES
 
-void Context::pushLayerId(Id _layer)
+#if IM3D_CULL_DRAW_PRIMITIVES
+namespace
 {
-    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change layer mid-primitive
-    int idx = findLayerIndex(_layer);
-    if (idx == -1)
-    { // not found, push new layer
-        idx = m_layerIdMap.size();
-        m_layerIdMap.push_back(_layer);
-        for (int i = 0; i < DrawPrimitive_Count; ++i)
+// # draw primitives gathered and tested at once by Context::cullDrawPrimitives().
+static const U32 kCullDrawBatchSize = 64;
+
+// Vertex j of draw primitive i is (x, y, z, size) = ([j][0][i], [j][1][i], [j][2][i], [j][3][i]).
+typedef float CullDrawBatch[3][4][kCullDrawBatchSize];
+
+// Test _count draw primitives of kVertsPerPrim vertices against _planeCount planes, write the result to _visible_. As per
+// Context::isVisible(const VertexData*, DrawPrimitiveType) a vertex is inside a plane if d > -size * _pixelScale * |p - _viewOrigin|
+// (1 instead of the distance if _ortho), tested as d > 0 || d^2 < (size * _pixelScale)^2 * |p - _viewOrigin|^2 to avoid the
+// per-vertex sqrt and divide. _pixelScale = 0 for triangles.
+template <int kVertsPerPrim>
+void CullDrawPrimitives(const CullDrawBatch &_batch, U32 _count, const Vec4 *_planes, int _planeCount, const Vec3 &_viewOrigin, float _pixelScale, bool _ortho, bool *_visible_)
+{
+    U32 i = 0;
+#if IM3D_SIMD
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 scale = _mm_set1_ps(_pixelScale);
+    const __m128 ox = _mm_set1_ps(_viewOrigin.x), oy = _mm_set1_ps(_viewOrigin.y), oz = _mm_set1_ps(_viewOrigin.z);
+    for (; i + 4 <= _count; i += 4)
+    {
+        __m128 x[3], y[3], z[3], t2[3];
+        for (int j = 0; j < kVertsPerPrim; ++j)
+        {
+            x[j] = _mm_loadu_ps(_batch[j][0] + i);
+            y[j] = _mm_loadu_ps(_batch[j][1] + i);
+            z[j] = _mm_loadu_ps(_batch[j][2] + i);
+            const __m128 s = _mm_mul_ps(_mm_loadu_ps(_batch[j][3] + i), scale);
+            t2[j] = _mm_mul_ps(s, s);
+            if (!_ortho)
+            {
+                const __m128 dx = _mm_sub_ps(x[j], ox), dy = _mm_sub_ps(y[j], oy), dz = _mm_sub_ps(z[j], oz);
+                t2[j] = _mm_mul_ps(t2[j], _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            }
+        }
+        __m128 visible = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < _planeCount; ++p)
+        {
+            const __m128 px = _mm_set1_ps(_planes[p].x), py = _mm_set1_ps(_planes[p].y), pz = _mm_set1_ps(_planes[p].z), pw = _mm_set1_ps(_planes[p].w);
+            __m128 inside = zero;
+            for (int j = 0; j < kVertsPerPrim; ++j)
+            {
+                const __m128 d = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, x[j]), _mm_mul_ps(py, y[j])), _mm_mul_ps(pz, z[j])), pw);
+                inside = _mm_or_ps(inside, _mm_or_ps(_mm_cmpgt_ps(d, zero), _mm_cmplt_ps(_mm_mul_ps(d, d), t2[j])));
+            }
+            visible = _mm_and_ps(visible, inside);
+            if (_mm_movemask_ps(visible) == 0)
+            {
+                break;
+            }
+        }
+        const int mask = _mm_movemask_ps(visible);
+        for (int k = 0; k < 4; ++k)
         {
-            m_vertexData[0].push_back((VertexList *)IM3D_MALLOC(sizeof(VertexList)));
-            *m_vertexData[0].back() = VertexList();
-            m_vertexData[1].push_back((VertexList *)IM3D_MALLOC(sizeof(VertexList)));
-            *m_vertexData[1].back() = VertexList();
+            _visible_[i + k] = (mask & (1 << k)) != 0;
         }
     }
-    m_layerIdStack.push_back(_layer);
-    m_layerIndex = idx;
+#endif
+    for (; i < _count; ++i)
+    {
+        float t2[3];
+        for (int j = 0; j < kVertsPerPrim; ++j)
+        {
+            const float s = _batch[j][3][i] * _pixelScale;
+            t2[j] = s * s;
+            if (!_ortho)
+            {
+                const float dx = _batch[j][0][i] - _viewOrigin.x, dy = _batch[j][1][i] - _viewOrigin.y, dz = _batch[j][2][i] - _viewOrigin.z;
+                t2[j] *= dx * dx + dy * dy + dz * dz;
+            }
+        }
+        bool visible = true;
+        for (int p = 0; p < _planeCount && visible; ++p)
+        {
+            bool inside = false;
+            for (int j = 0; j < kVertsPerPrim; ++j)
+            {
+                const float d = _planes[p].x * _batch[j][0][i] + _planes[p].y * _batch[j][1][i] + _planes[p].z * _batch[j][2][i] - _planes[p].w;
+                inside |= d > 0.0f || d * d < t2[j];
+            }
+            visible = inside;
+        }
+        _visible_[i] = visible;
+    }
 }
-void Context::popLayerId()
+} // namespace
+#endif // IM3D_CULL_DRAW_PRIMITIVES
+
+/*******************************************************************************
+
+                              Occlusion culling
+
+*******************************************************************************/
+
+namespace
 {
-    IM3D_ASSERT(m_layerIdStack.size() > 1);
-    m_layerIdStack.pop_back();
-    m_layerIndex = findLayerIndex(m_layerIdStack.back());
+// Occlusion buffer pixels are grouped into square tiles which store the farthest depth of their pixels, isOccluded() tests whole
+// tiles first and only visits pixels where the tile isn't conclusive.
+static const U32 kOcclusionTileSize = 8;
+// Default AppData::m_occlusionBufferWidth.
+static const U32 kOcclusionDefaultWidth = 256;
+// Vertices with w below this are behind the view origin, occluder triangles are clipped against it and occludees crossing it are visible.
+static const float kOcclusionMinW = 1e-5f;
+
+// Pixels touched by [_min, _max] (both >= 0) as [_begin_, _end_). Converts via int, float -> unsigned and ceilf() are slow without SSE4.1.
+inline void PixelRange(float _min, float _max, U32 &_begin_, U32 &_end_)
+{
+    const int end = (int)_max;
+    _begin_ = (U32)(int)_min;
+    _end_ = (U32)((float)end < _max ? end + 1 : end);
 }
 
-Context::Context()
+// Rasterize a triangle (x, y in pixels, z = depth) into _depth_ (_width * _height, _width a multiple of 4). Pixels are written if
+// their center is covered, with the farthest depth of the triangle's plane over the pixel. Silhouette pixels may be partially covered,
+// see Context::updateOcclusionTest().
+void RasterizeOccluder(Vec3 _v0, Vec3 _v1, Vec3 _v2, float *_depth_, U32 _width, U32 _height)
 {
-    m_sortCalled = false;
+    float area = (_v1.x - _v0.x) * (_v2.y - _v0.y) - (_v1.y - _v0.y) * (_v2.x - _v0.x);
+    if (fabsf(area) < 1e-6f)
+    {
+        return;
+    }
+    if (area < 0.0f)
+    { // occluders are double sided
+        Vec3 tmp = _v1;
+        _v1 = _v2;
+        _v2 = tmp;
+        area = -area;
+    }
+
+    float minX = Max(Min(_v0.x, Min(_v1.x, _v2.x)), 0.0f);
+    float maxX = Min(Max(_v0.x, Max(_v1.x, _v2.x)), (float)_width);
+    float minY = Max(Min(_v0.y, Min(_v1.y, _v2.y)), 0.0f);
+    float maxY = Min(Max(_v0.y, Max(_v1.y, _v2.y)), (float)_height);
+    if (minX >= maxX || minY >= maxY)
+    {
+        return;
+    }
+    U32 x0, x1, y0, y1;
+    PixelRange(minX, maxX, x0, x1);
+    PixelRange(minY, maxY, y0, y1);
+    x0 &= ~3u;
+
+    // edge functions e = a * x + b * y + c, >= 0 inside
+    const Vec3 *v[3] = {&_v0, &_v1, &_v2};
+    float ea[3], eb[3], ec[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        const Vec3 &a = *v[i];
+        const Vec3 &b = *v[(i + 1) % 3];
+        ea[i] = a.y - b.y;
+        eb[i] = b.x - a.x;
+        ec[i] = -ea[i] * a.x - eb[i] * a.y;
+    }
+    // depth plane, offset to the farthest depth over the pixel
+    const float dzdx = ((_v1.z - _v0.z) * (_v2.y - _v0.y) - (_v2.z - _v0.z) * (_v1.y - _v0.y)) / area;
+    const float dzdy = ((_v2.z - _v0.z) * (_v1.x - _v0.x) - (_v1.z - _v0.z) * (_v2.x - _v0.x)) / area;
+    const float dzc = _v0.z - dzdx * _v0.x - dzdy * _v0.y + 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+
+#if IM3D_SIMD
+    const __m128 a0 = _mm_set1_ps(ea[0]), a1 = _mm_set1_ps(ea[1]), a2 = _mm_set1_ps(ea[2]);
+    const __m128 zx = _mm_set1_ps(dzdx);
+    const __m128 zero = _mm_setzero_ps();
+    for (U32 y = y0; y < y1; ++y)
+    {
+        const float py = (float)y + 0.5f;
+        const __m128 c0 = _mm_set1_ps(eb[0] * py + ec[0]);
+        const __m128 c1 = _mm_set1_ps(eb[1] * py + ec[1]);
+        const __m128 c2 = _mm_set1_ps(eb[2] * py + ec[2]);
+        const __m128 cz = _mm_set1_ps(dzdy * py + dzc);
+        float *row = _depth_ + y * _width;
+        for (U32 x = x0; x < x1; x += 4)
+        {
+            const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), c0), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), c1), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), c2), zero));
+            if (_mm_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+            const __m128 z = _mm_add_ps(_mm_mul_ps(zx, px), cz);
+            const __m128 d = _mm_loadu_ps(row + x);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(d, z)), _mm_andnot_ps(inside, d)));
+        }
+    }
+#else
+    for (U32 y = y0; y < y1; ++y)
+    {
+        const float py = (float)y + 0.5f;
+        float *row = _depth_ + y * _width;
+        for (U32 x = x0; x < x1; ++x)
+        {
+            const float px = (float)x + 0.5f;
+            if (ea[0] * px + eb[0] * py + ec[0] >= 0.0f && ea[1] * px + eb[1] * py + ec[1] >= 0.0f && ea[2] * px + eb[2] * py + ec[2] >= 0.0f)
+            {
+                row[x] = Min(row[x], dzdx * px + dzdy * py + dzc);
+            }
+        }
+    }
+#endif
+}
+} // namespace
+
+/*******************************************************************************
+
+                                 Context
+
+*******************************************************************************/
+
+static Context g_DefaultContext;
+IM3D_THREAD_LOCAL Context *Im3d::internal::g_CurrentContext = &g_DefaultContext;
+
+// Max # vertices staged in Context::m_primVertices before they are flushed to the vertex list.
+static const U32 VertexBatchSize = 512;
+
+void Context::begin(PrimitiveMode _mode)
+{
+    IM3D_ASSERT(!m_endFrameCalled);                // Begin*() called after EndFrame() but before NewFrame(), or forgot to call NewFrame()
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // forgot to call End()
+    m_primMode = _mode;
+    m_vertCountThisPrim = 0;
+    m_reservedThisPrim = false;
+    m_minVertThisPrim = Vec3(FLT_MAX);
+    m_maxVertThisPrim = Vec3(-FLT_MAX);
+    switch (m_primMode)
+    {
+    case PrimitiveMode_Points:
+        m_primType = DrawPrimitive_Points;
+        break;
+    case PrimitiveMode_Lines:
+    case PrimitiveMode_LineStrip:
+    case PrimitiveMode_LineLoop:
+        m_primType = DrawPrimitive_Lines;
+        break;
+    case PrimitiveMode_Triangles:
+    case PrimitiveMode_TriangleStrip:
+        m_primType = DrawPrimitive_Triangles;
+        break;
+    default:
+        break;
+    };
+    m_firstVertThisPrim = getCurrentVertexList()->size();
+#if IM3D_INDEXED_PRIMITIVES
+    m_firstIndexThisPrim = getCurrentIndexList()->size();
+#endif
+}
+
+void Context::end()
+{
+    IM3D_ASSERT(m_primMode != PrimitiveMode_None); // End() called without Begin*()
+    IM3D_ASSERT(!m_reservedThisPrim);              // use commitVertices() to end a primitive started via reserveVertices()
+    flushVertices();
+    if (m_recordingIndex != -1)
+    {
+        recordPrimitive();
+        m_primMode = PrimitiveMode_None;
+        m_primType = DrawPrimitive_Count;
+        return;
+    }
+    if (m_vertCountThisPrim > 0)
+    {
+        // discard the primitive if its bounds project to fewer than AppData::m_cullMinPixelSize pixels or are hidden by the occluders
+        bool culled = false;
+        if (m_primType != DrawPrimitive_Points && m_appData.m_cullMinPixelSize > 0.0f)
+        {
+            Vec3 center = (m_minVertThisPrim + m_maxVertThisPrim) * 0.5f;
+            culled = worldSizeToPixels(center, Length(m_maxVertThisPrim - m_minVertThisPrim)) < m_appData.m_cullMinPixelSize;
+        }
+        culled = culled || isOccluded(m_minVertThisPrim, m_maxVertThisPrim);
+        if (culled)
+        {
+            VertexList *vertexList = getCurrentVertexList();
+            vertexList->resize(m_firstVertThisPrim, vertexList->back());
+#if IM3D_INDEXED_PRIMITIVES
+            getCurrentIndexList()->resize(m_firstIndexThisPrim, 0);
+#endif
+            m_vertCountThisPrim = 0;
+        }
+    }
+    if (m_vertCountThisPrim > 0)
+    {
+        VertexList *vertexList = getCurrentVertexList();
+        switch (m_primMode)
+        {
+        case PrimitiveMode_Points:
+            break;
+        case PrimitiveMode_Lines:
+            IM3D_ASSERT(m_vertCountThisPrim % 2 == 0);
+            break;
+        case PrimitiveMode_LineStrip:
+            IM3D_ASSERT(m_vertCountThisPrim > 1);
+            break;
+        case PrimitiveMode_LineLoop:
+            IM3D_ASSERT(m_vertCountThisPrim > 1);
+#if IM3D_INDEXED_PRIMITIVES
+            getCurrentIndexList()->push_back(vertexList->size() - 1);
+            getCurrentIndexList()->push_back(m_firstVertThisPrim);
+#else
+            vertexList->push_back(vertexList->back());
+            vertexList->push_back((*vertexList)[m_firstVertThisPrim]);
+#endif
+            break;
+        case PrimitiveMode_Triangles:
+            IM3D_ASSERT(m_vertCountThisPrim % 3 == 0);
+            break;
+        case PrimitiveMode_TriangleStrip:
+            IM3D_ASSERT(m_vertCountThisPrim >= 3);
+            break;
+        default:
+            break;
+        };
+#if IM3D_CULL_PRIMITIVES
+        // \hack force the bounds to be slightly conservative to account for point/line size
+        m_minVertThisPrim = m_minVertThisPrim - Vec3(1.0f);
+        m_maxVertThisPrim = m_maxVertThisPrim + Vec3(1.0f);
+        // defer the visibility test, cullPrimitives() tests all primitives at once during endFrame()
+        CullRecord *rec = m_cullRecords.expand(1);
+        rec->m_list = m_layerIndex * DrawPrimitive_Count + m_primType;
+        rec->m_vertexDataIndex = (U32)m_vertexDataIndex;
+        rec->m_firstVertex = m_firstVertThisPrim;
+        rec->m_endVertex = vertexList->size();
+#if IM3D_INDEXED_PRIMITIVES
+        rec->m_firstIndex = m_firstIndexThisPrim;
+        rec->m_endIndex = getCurrentIndexList()->size();
+#else
+        rec->m_firstIndex = rec->m_endIndex = 0;
+#endif
+        m_cullBounds[0].push_back(m_minVertThisPrim.x);
+        m_cullBounds[1].push_back(m_minVertThisPrim.y);
+        m_cullBounds[2].push_back(m_minVertThisPrim.z);
+        m_cullBounds[3].push_back(m_maxVertThisPrim.x);
+        m_cullBounds[4].push_back(m_maxVertThisPrim.y);
+        m_cullBounds[5].push_back(m_maxVertThisPrim.z);
+#endif
+    }
+    m_primMode = PrimitiveMode_None;
+    m_primType = DrawPrimitive_Count;
+#if IM3D_CULL_PRIMITIVES
+    // \debug draw primitive BBs
+    //if (m_enableCulling) {
+    //	m_enableCulling = false;
+    //	pushColor(Im3d::Color_Magenta);
+    //	pushSize(1.0f);
+    //	pushMatrix(Mat4(1.0f));
+    //	DrawAlignedBox(m_minVertThisPrim, m_maxVertThisPrim);
+    //	popMatrix();
+    //	popColor();
+    //	popSize();
+    //	m_enableCulling = true;
+    //}
+#endif
+}
+
+void Context::vertex(const Vec3 &_position, float _size, Color _color)
+{
+    IM3D_ASSERT(m_primMode != PrimitiveMode_None); // Vertex() called without Begin*()
+    IM3D_ASSERT(!m_reservedThisPrim);              // Vertex() called between reserveVertices() and commitVertices()
+    if (!m_cullScopeVisible)
+    {
+        return;
+    }
+
+    // matrix/alpha are applied per batch in flushVertices()
+    m_primVertices.push_back(VertexData(_position, _size, _color));
+    if (m_primVertices.size() == VertexBatchSize)
+    {
+        flushVertices();
+    }
+}
+
+void Context::vertices(const Vec3 *_positions, const Color *_colors, const float *_sizes, U32 _count)
+{
+    Color color = getColor();
+    float size = getSize();
+    appendVertices(
+        _positions, sizeof(Vec3),
+        _sizes ? _sizes : &size, _sizes ? sizeof(float) : 0,
+        _colors ? _colors : &color, _colors ? sizeof(Color) : 0,
+        _count);
+}
+
+void Context::vertices(const VertexData *_vertices, U32 _count)
+{
+    appendVertices(
+        (const Vec3 *)&_vertices->m_positionSize.x, sizeof(VertexData),
+        &_vertices->m_positionSize.w, sizeof(VertexData),
+        &_vertices->m_color, sizeof(VertexData),
+        _count);
+}
+
+void Context::appendVertices(
+    const Vec3 *_positions, U32 _positionStride,
+    const float *_sizes, U32 _sizeStride,
+    const Color *_colors, U32 _colorStride,
+    U32 _count)
+{
+    IM3D_ASSERT(m_primMode != PrimitiveMode_None); // Vertices() called without Begin*()
+    IM3D_ASSERT(!m_reservedThisPrim);              // Vertices() called between reserveVertices() and commitVertices()
+    if (_count == 0 || !m_cullScopeVisible)
+    {
+        return;
+    }
+
+    const char *positions = (const char *)_positions;
+    const char *sizes = (const char *)_sizes;
+    const char *colors = (const char *)_colors;
+    U32 i = 0;
+    while (i < _count)
+    {
+        U32 n = VertexBatchSize - m_primVertices.size();
+        n = _count - i < n ? _count - i : n;
+        VertexData *vd = m_primVertices.expand(n);
+        for (U32 j = 0; j < n; ++j, ++i)
+        {
+            vd[j] = VertexData(
+                *(const Vec3 *)(positions + i * _positionStride),
+                *(const float *)(sizes + i * _sizeStride),
+                *(const Color *)(colors + i * _colorStride));
+        }
+        if (m_primVertices.size() == VertexBatchSize)
+        {
+            flushVertices();
+        }
+    }
+}
+
+void Context::flushVertices()
+{
+    const U32 count = m_primVertices.size();
+    if (count == 0)
+    {
+        return;
+    }
+    if (m_recordingIndex != -1)
+    {
+        TransformVertices(m_primVertices.data(), count, m_matrixStack.size() > 1 ? &m_matrixStack.back() : nullptr, m_alphaStack.back());
+        memcpy(m_recordVertices.expand(count), m_primVertices.data(), sizeof(VertexData) * count);
+        m_primVertices.clear();
+        return;
+    }
+    TransformVertices(m_primVertices.data(), count, m_matrixStack.size() > 1 ? &m_matrixStack.back() : nullptr, m_alphaStack.back());
+    updatePrimBounds(m_primVertices.data(), count);
+
+#if IM3D_VERTEX_COMPACT
+    m_primDrawVertices.clear();
+    DrawVertex *encoded = m_primDrawVertices.expand(count);
+    for (U32 i = 0; i < count; ++i)
+    {
+        const VertexData &vd = m_primVertices[i];
+        encoded[i] = DrawVertex(Vec3(vd.m_positionSize) - m_origin, vd.m_positionSize.w, vd.m_color);
+    }
+    const DrawVertex *src = encoded;
+#else
+    const DrawVertex *src = m_primVertices.data();
+#endif
+
+#if IM3D_INDEXED_PRIMITIVES
+    // write unique vertices, strips/loops are expanded via the index list
+    VertexList *vertexList = getCurrentVertexList();
+    const U32 first = vertexList->size(); // list index of src[0]
+    memcpy(vertexList->expand(count), src, sizeof(DrawVertex) * count);
+    IndexList *indexList = getCurrentIndexList();
+    U32 i = 0;
+    switch (m_primMode)
+    {
+    case PrimitiveMode_LineStrip:
+    case PrimitiveMode_LineLoop:
+    {
+        i = m_vertCountThisPrim >= 1 ? 0 : 1;
+        U32 *out = indexList->expand((count - i) * 2);
+        for (; i < count; ++i)
+        {
+            *out++ = first + i - 1;
+            *out++ = first + i;
+        }
+        break;
+    }
+    case PrimitiveMode_TriangleStrip:
+    {
+        i = m_vertCountThisPrim >= 2 ? 0 : 2 - m_vertCountThisPrim;
+        i = i < count ? i : count;
+        U32 *out = indexList->expand((count - i) * 3);
+        for (; i < count; ++i)
+        {
+            *out++ = first + i - 2;
+            *out++ = first + i - 1;
+            *out++ = first + i;
+        }
+        break;
+    }
+    default:
+    {
+        U32 *out = indexList->expand(count);
+        for (; i < count; ++i)
+        {
+            *out++ = first + i;
+        }
+        break;
+    }
+    };
+    m_vertCountThisPrim += count;
+#else
+    // expand strips/loops, the output size is known up front so the list grows at most once
+    VertexList *vertexList = getCurrentVertexList();
+    U32 outCount = count;
+    U32 directCount = count; // # vertices which are not preceded by copies of previous vertices
+    switch (m_primMode)
+    {
+    case PrimitiveMode_LineStrip:
+    case PrimitiveMode_LineLoop:
+        directCount = m_vertCountThisPrim >= 2 ? 0 : (count < 2 - m_vertCountThisPrim ? count : 2 - m_vertCountThisPrim);
+        outCount += (count - directCount);
+        break;
+    case PrimitiveMode_TriangleStrip:
+        directCount = m_vertCountThisPrim >= 3 ? 0 : (count < 3 - m_vertCountThisPrim ? count : 3 - m_vertCountThisPrim);
+        outCount += (count - directCount) * 2;
+        break;
+    default:
+        break;
+    };
+    DrawVertex *out = vertexList->expand(outCount);
+    memcpy(out, src, sizeof(DrawVertex) * directCount);
+    out += directCount;
+    switch (m_primMode)
+    {
+    case PrimitiveMode_LineStrip:
+    case PrimitiveMode_LineLoop:
+        for (U32 i = directCount; i < count; ++i)
+        {
+            out[0] = out[-1];
+            out[1] = src[i];
+            out += 2;
+        }
+        break;
+    case PrimitiveMode_TriangleStrip:
+        for (U32 i = directCount; i < count; ++i)
+        {
+            out[0] = out[-2];
+            out[1] = out[-1];
+            out[2] = src[i];
+            out += 3;
+        }
+        break;
+    default:
+        break;
+    };
+    IM3D_ASSERT(out == vertexList->end());
+
+    m_vertCountThisPrim += outCount;
+#endif
+    m_primVertices.clear();
+}
+
+void Context::updatePrimBounds(const VertexData *_vertices, U32 _count)
+{
+#if !IM3D_CULL_PRIMITIVES
+    if (m_appData.m_cullMinPixelSize <= 0.0f && !m_occlusionEnabled)
+    {
+        return;
+    }
+#endif
+#if IM3D_SIMD
+    // w (size) is accumulated too but discarded
+    __m128 vmin = _mm_setr_ps(m_minVertThisPrim.x, m_minVertThisPrim.y, m_minVertThisPrim.z, 0.0f);
+    __m128 vmax = _mm_setr_ps(m_maxVertThisPrim.x, m_maxVertThisPrim.y, m_maxVertThisPrim.z, 0.0f);
+    for (U32 i = 0; i < _count; ++i)
+    {
+        __m128 p = _mm_loadu_ps(&_vertices[i].m_positionSize.x);
+        vmin = _mm_min_ps(vmin, p);
+        vmax = _mm_max_ps(vmax, p);
+    }
+    float bounds[8];
+    _mm_storeu_ps(bounds, vmin);
+    _mm_storeu_ps(bounds + 4, vmax);
+    m_minVertThisPrim = Vec3(bounds[0], bounds[1], bounds[2]);
+    m_maxVertThisPrim = Vec3(bounds[4], bounds[5], bounds[6]);
+#else
+    for (U32 i = 0; i < _count; ++i)
+    {
+        Vec3 p = Vec3(_vertices[i].m_positionSize);
+        m_minVertThisPrim = Min(m_minVertThisPrim, p);
+        m_maxVertThisPrim = Max(m_maxVertThisPrim, p);
+    }
+#endif
+}
+
+VertexData *Context::reserveVertices(PrimitiveMode _mode, U32 _count)
+{
+    IM3D_ASSERT(_mode == PrimitiveMode_Points || _mode == PrimitiveMode_Lines || _mode == PrimitiveMode_Triangles); // strips/loops can't be written in place
+    begin(_mode);
+    m_reservedThisPrim = true;
+    if (!m_cullScopeVisible)
+    {
+        // the caller still writes the vertices, commitVertices() discards them
+        m_primVertices.clear();
+        return m_primVertices.expand(_count);
+    }
+    if (m_recordingIndex != -1)
+    {
+        // stage the vertices, commitVertices() moves them to the recording
+        m_primVertices.clear();
+        return m_primVertices.expand(_count);
+    }
+#if IM3D_VERTEX_COMPACT
+    // the vertex list format differs from VertexData, stage the vertices and encode them in commitVertices()
+    m_primVertices.clear();
+    return m_primVertices.expand(_count);
+#else
+    m_vertCountThisPrim = _count;
+    return getCurrentVertexList()->expand(_count);
+#endif
+}
+
+void Context::commitVertices()
+{
+    IM3D_ASSERT(m_reservedThisPrim); // commitVertices() called without reserveVertices()
+    if (!m_cullScopeVisible)
+    {
+        m_primVertices.clear();
+        m_reservedThisPrim = false;
+        end();
+        return;
+    }
+    if (m_recordingIndex != -1)
+    {
+        flushVertices();
+        m_reservedThisPrim = false;
+        end();
+        return;
+    }
+#if IM3D_VERTEX_COMPACT
+    flushVertices();
+#else
+    VertexList *vertexList = getCurrentVertexList();
+    IM3D_ASSERT(vertexList->size() == m_firstVertThisPrim + m_vertCountThisPrim); // vertex list modified since reserveVertices()
+
+    VertexData *vd = vertexList->data() + m_firstVertThisPrim;
+    TransformVertices(vd, m_vertCountThisPrim, m_matrixStack.size() > 1 ? &m_matrixStack.back() : nullptr, m_alphaStack.back());
+    updatePrimBounds(vd, m_vertCountThisPrim);
+#if IM3D_INDEXED_PRIMITIVES
+    U32 *indices = getCurrentIndexList()->expand(m_vertCountThisPrim);
+    for (U32 i = 0; i < m_vertCountThisPrim; ++i)
+    {
+        indices[i] = m_firstVertThisPrim + i;
+    }
+#endif
+#endif // IM3D_VERTEX_COMPACT
+
+    m_reservedThisPrim = false;
+    end();
+}
+
+namespace
+{
+// Per-layer lists are stored by value in a per-context table. Frame lists (vertex/index data) allocate via the frame arena.
+template <typename T>
+void AddList(Vector<Vector<T>> &_table_, const Allocator *_allocator)
+{
+    Vector<T> *list = new (_table_.expand(1)) Vector<T>(); // expand() returns uninitialized memory
+    list->setAllocator(_allocator);
+}
+// Call after FrameArena::reset(); reserve the previous capacity so that the list doesn't need to grow again.
+template <typename T>
+void ResetFrameList(Vector<T> &_list_)
+{
+    U32 capacity = _list_.capacity();
+    _list_.release();
+    if (capacity > 0)
+    {
+        _list_.reserve(capacity);
+    }
+}
+
+// Segment count range for AppData::m_lodPixelError.
+const int kLodMinDetail = 3;
+const int kLodMaxDetail = 256;
+// A shape keeps its previous detail while the ideal detail is within this fraction of it.
+const float kLodHysteresis = 0.25f;
+// Bounds for the factor applied to AppData::m_lodPixelError to meet AppData::m_lodVertexBudget. Within budget the factor relaxes
+// by kLodRelaxRate per frame once the vertex count drops below kLodRelaxThreshold * budget.
+const float kLodMaxErrorScale = 64.0f;
+const float kLodRelaxThreshold = 0.9f;
+const float kLodRelaxRate = 0.9f;
+// DrawPolyline() error (pixels) if AppData::m_lodPixelError isn't set.
+const float kPolylineDefaultPixelError = 0.5f;
+// Max # points per initial DrawPolyline() simplification range.
+const U32 kPolylineMaxRange = 1024;
+} // namespace
+
+void Context::drawPolyline(const Vec3 *_points, const Color *_colors, U32 _count, float _pixelError)
+{
+    if (_count < 2 || !m_cullScopeVisible)
+    {
+        return;
+    }
+    if (m_recordingIndex != -1)
+    {
+        // the simplification depends on the view, record the whole polyline
+        begin(PrimitiveMode_LineStrip);
+        vertices(_points, _colors, nullptr, _count);
+        end();
+        return;
+    }
+
+    // simplify and cull in world space, the output vertices are copied from _points and transformed as per vertex()
+    const Vec3 *points = _points;
+    if (m_matrixStack.size() > 1)
+    {
+        const Mat4 &m = m_matrixStack.back();
+        m_polylinePoints.clear();
+        Vec3 *p = m_polylinePoints.expand(_count);
+        for (U32 i = 0; i < _count; ++i)
+        {
+            p[i] = m * _points[i];
+        }
+        points = p;
+    }
+    m_polylinePixelSize.clear();
+    float *pixelSize = m_polylinePixelSize.expand(_count);
+    const float worldPerPixel = m_appData.m_projScaleY / m_appData.m_viewportSize.y;
+    for (U32 i = 0; i < _count; ++i)
+    {
+        float d = m_appData.m_projOrtho ? 1.0f : Length(points[i] - m_appData.m_viewOrigin);
+        pixelSize[i] = d * worldPerPixel;
+    }
+    float error = _pixelError;
+    if (error < 0.0f)
+    {
+        error = m_appData.m_lodPixelError > 0.0f ? m_appData.m_lodPixelError * m_lodErrorScale : kPolylineDefaultPixelError;
+    }
+
+    // radial distance pass, drop points within the error of the previous kept point (O(n), reduces densely sampled input)
+    m_polylineIndices.clear();
+    m_polylineIndices.push_back(0);
+    U32 last = 0;
+    for (U32 i = 1; i < _count - 1; ++i)
+    {
+        float e = error * pixelSize[i];
+        if (Length2(points[i] - points[last]) > e * e)
+        {
+            m_polylineIndices.push_back(i);
+            last = i;
+        }
+    }
+    m_polylineIndices.push_back(_count - 1);
+
+    // Douglas-Peucker pass, ranges are processed first to last so the kept points are compacted in place
+    U32 *indices = m_polylineIndices.data();
+    U32 indexCount = m_polylineIndices.size();
+    if (error > 0.0f && indexCount > 2)
+    {
+        // 1 / squared world space error of the kept points, stored after pixelSize
+        float *rcpError2 = m_polylinePixelSize.expand(_count);
+        pixelSize = m_polylinePixelSize.data();
+        for (U32 k = 0; k < indexCount; ++k)
+        {
+            const U32 i = indices[k];
+            const float e = error * pixelSize[i];
+            rcpError2[i] = 1.0f / (e * e);
+        }
+        // start from ranges of at most kPolylineMaxRange points, bounds the recursion depth at the cost of a few extra points
+        m_polylineStack.clear();
+        for (U32 rangeLast = indexCount - 1; rangeLast > 0;)
+        {
+            U32 rangeFirst = (rangeLast - 1) / kPolylineMaxRange * kPolylineMaxRange;
+            m_polylineStack.push_back(rangeFirst);
+            m_polylineStack.push_back(rangeLast);
+            rangeLast = rangeFirst;
+        }
+        indexCount = 0;
+        while (!m_polylineStack.empty())
+        {
+            U32 rangeLast = m_polylineStack.back();
+            m_polylineStack.pop_back();
+            U32 rangeFirst = m_polylineStack.back();
+            m_polylineStack.pop_back();
+
+            // find the point with the largest distance to the segment relative to its error
+            const Vec3 &a = points[indices[rangeFirst]];
+            const Vec3 ab = points[indices[rangeLast]] - a;
+            const float ab2 = Length2(ab);
+            const float rcpAb2 = ab2 > 0.0f ? 1.0f / ab2 : 0.0f;
+            float maxRatio = 1.0f;
+            U32 split = 0;
+            for (U32 k = rangeFirst + 1; k < rangeLast; ++k)
+            {
+                const U32 i = indices[k];
+                const Vec3 ap = points[i] - a;
+                const float t = Clamp(Dot(ap, ab) * rcpAb2, 0.0f, 1.0f);
+                const float ratio = Length2(ap - ab * t) * rcpError2[i];
+                if (ratio > maxRatio)
+                {
+                    maxRatio = ratio;
+                    split = k;
+                }
+            }
+            if (split != 0)
+            {
+                m_polylineStack.push_back(split);
+                m_polylineStack.push_back(rangeLast);
+                m_polylineStack.push_back(rangeFirst);
+                m_polylineStack.push_back(split);
+            }
+            else
+            {
+                indices[indexCount++] = indices[rangeFirst];
+            }
+        }
+        indices[indexCount++] = m_polylineIndices.back();
+    }
+
+    // write runs of visible segments as line strips
+    const float size = getSize();
+    const Color color = getColor();
+    m_polylineVertices.clear();
+    for (U32 k = 0; k < indexCount; ++k)
+    {
+        bool visible = k + 1 < indexCount;
+#if IM3D_CULL_PRIMITIVES
+        for (int j = 0; j < m_cullFrustumCount && visible; ++j)
+        {
+            const Vec4 &plane = m_cullFrustum[j];
+            visible = Distance(plane, points[indices[k]]) > -size * pixelSize[indices[k]]
+                || Distance(plane, points[indices[k + 1]]) > -size * pixelSize[indices[k + 1]];
+        }
+#endif
+        if (visible)
+        {
+            if (m_polylineVertices.empty())
+            {
+                m_polylineVertices.push_back(VertexData(_points[indices[k]], size, _colors ? _colors[indices[k]] : color));
+            }
+            m_polylineVertices.push_back(VertexData(_points[indices[k + 1]], size, _colors ? _colors[indices[k + 1]] : color));
+        }
+        else if (!m_polylineVertices.empty())
+        {
+            begin(PrimitiveMode_LineStrip);
+            vertices(m_polylineVertices.data(), m_polylineVertices.size());
+            end();
+            m_polylineVertices.clear();
+        }
+    }
+}
+
+void Context::reset()
+{
+    // all state stacks should be default here, else there was a mismatched Push*()/Pop*()
+    IM3D_ASSERT(m_colorStack.size() == 1);
+    IM3D_ASSERT(m_alphaStack.size() == 1);
+    IM3D_ASSERT(m_sizeStack.size() == 1);
+    IM3D_ASSERT(m_enableSortingStack.size() == 1);
+    IM3D_ASSERT(m_layerIdStack.size() == 1);
+    IM3D_ASSERT(m_matrixStack.size() == 1);
+    IM3D_ASSERT(m_idStack.size() == 1);
+    IM3D_ASSERT(m_cullScopeStack.size() == 1);
+    IM3D_ASSERT(m_recordingIndex == -1); // missing EndRecording()
+
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None);
+    m_primMode = PrimitiveMode_None;
+    m_primType = DrawPrimitive_Count;
+
+    // adapt the LOD error scale to the previous frame's vertex count
+    if (m_appData.m_lodVertexBudget > 0)
+    {
+        U32 vertexCount = 0;
+        for (int i = 0; i < 2; ++i)
+        {
+            for (const VertexList &vertexList : m_vertexData[i])
+            {
+                vertexCount += vertexList.size();
+            }
+        }
+        float budget = (float)m_appData.m_lodVertexBudget;
+        if ((float)vertexCount > budget)
+        {
+            // detail is roughly proportional to 1/sqrt(error), scaling by the ratio approaches the budget over a few frames
+            m_lodErrorScale = Min(m_lodErrorScale * (float)vertexCount / budget, kLodMaxErrorScale);
+        }
+        else if ((float)vertexCount < budget * kLodRelaxThreshold)
+        {
+            m_lodErrorScale = Max(m_lodErrorScale * kLodRelaxRate, 1.0f);
+        }
+    }
+    else
+    {
+        m_lodErrorScale = 1.0f;
+    }
+    // swap the LOD tables, the current frame's becomes the previous frame's
+    m_lodHashIndex ^= 1;
+    if (!m_lodHash[m_lodHashIndex].empty())
+    {
+        memset(m_lodHash[m_lodHashIndex].data(), 0, sizeof(LodEntry) * m_lodHash[m_lodHashIndex].size());
+    }
+    m_lodCount = 0;
+
+    // vertex/index data from the previous frame is discarded with the frame arena
+    m_heapAllocCount = 0;
+    m_heapFreeCount = 0;
+    m_frameArena.reset();
+    for (U32 i = 0; i < m_vertexData[0].size(); ++i)
+    {
+        ResetFrameList(m_vertexData[0][i]);
+        ResetFrameList(m_vertexData[1][i]);
+    }
+    for (U32 i = 0; i < m_indexData[0].size(); ++i)
+    {
+        ResetFrameList(m_indexData[0][i]);
+        ResetFrameList(m_indexData[1][i]);
+    }
+#if IM3D_CULL_PRIMITIVES
+    ResetFrameList(m_cullRecords);
+    for (int i = 0; i < 6; ++i)
+    {
+        ResetFrameList(m_cullBounds[i]);
+    }
+#endif
+    m_drawLists.clear();
+    m_sortCalled = false;
+    m_sortSkipCount = 0;
+    m_sortMergeCount = 0;
+    m_cullDrawPrimitiveCount = 0;
+    m_endFrameCalled = false;
+    m_occlusionEnabled = false;
+
+    m_appData.m_viewDirection = Normalize(m_appData.m_viewDirection);
+#if IM3D_VERTEX_COMPACT
+    m_origin = m_appData.m_viewOrigin;
+#endif
+
+    // copy keydown array internally so that we can make a delta to detect key presses
+    memcpy(m_keyDownPrev, m_keyDownCurr, Key_Count);       // \todo avoid this copy, use an index
+    memcpy(m_keyDownCurr, m_appData.m_keyDown, Key_Count); // must copy in case m_keyDown is updated after reset (e.g. by an app callback)
+
+    // process cull frustum
+    m_cullFrustumCount = 0;
+    for (int i = 0; i < FrustumPlane_Count; ++i)
+    {
+        const Vec4 &plane = m_appData.m_cullFrustum[i];
+        if (m_appData.m_projOrtho && i == FrustumPlane_Near)
+        { // skip near plane if perspective
+            continue;
+        }
+        if (std::isinf(plane.w))
+        { // may be the case e.g. for the far plane if projection is infinite
+            continue;
+        }
+        m_cullFrustum[m_cullFrustumCount++] = plane;
+    }
+
+    // update gizmo modes
+    if (wasKeyPressed(Action_GizmoTranslation))
+    {
+        m_gizmoMode = GizmoMode_Translation;
+        resetId();
+    }
+    else if (wasKeyPressed(Action_GizmoRotation))
+    {
+        m_gizmoMode = GizmoMode_Rotation;
+        resetId();
+    }
+    else if (wasKeyPressed(Action_GizmoScale))
+    {
+        m_gizmoMode = GizmoMode_Scale;
+        resetId();
+    }
+    if (wasKeyPressed(Action_GizmoLocal))
+    {
+        m_gizmoLocal = !m_gizmoLocal;
+        resetId();
+    }
+}
+
+void Context::merge(const Context &_src)
+{
+    IM3D_ASSERT(!m_endFrameCalled && !_src.m_endFrameCalled); // call MergeContexts() before calling EndFrame()
+
+    // layer IDs
+    for (auto &id : _src.m_layerIdMap)
+    {
+        pushLayerId(id); // add a new layer if id doesn't alrady exist
+        popLayerId();
+    }
+
+#if IM3D_CULL_PRIMITIVES
+    // where each _src list was appended, to rebase _src's cull records
+    struct ListRebase
+    {
+        U32 m_list;
+        U32 m_firstVertex;
+        U32 m_firstIndex;
+    };
+    const U32 srcListCount = _src.m_vertexData[0].size();
+    ListRebase *rebase = (ListRebase *)m_frameArena.allocate(sizeof(ListRebase) * srcListCount * 2, alignof(ListRebase));
+#endif
+
+    // vertex data
+    for (U32 i = 0; i < 2; ++i)
+    {
+        auto &vertexData = _src.m_vertexData[i];
+        for (U32 j = 0; j < vertexData.size(); ++j)
+        {
+            // for each layer in _src, find the matching layer in this
+            Id layerId = _src.m_layerIdMap[j / DrawPrimitive_Count];
+            int layerIndex = findLayerIndex(layerId);
+            IM3D_ASSERT(layerIndex >= 0);
+            U32 k = j % DrawPrimitive_Count;
+            VertexList &dstVertexData = m_vertexData[i][layerIndex * DrawPrimitive_Count + k];
+#if IM3D_CULL_PRIMITIVES
+            ListRebase &lr = rebase[i * srcListCount + j];
+            lr.m_list = layerIndex * DrawPrimitive_Count + k;
+            lr.m_firstVertex = dstVertexData.size();
+#if IM3D_INDEXED_PRIMITIVES
+            lr.m_firstIndex = m_indexData[i][lr.m_list].size();
+#else
+            lr.m_firstIndex = 0;
+#endif
+#endif
+#if IM3D_INDEXED_PRIMITIVES
+            // rebase _src indices to the end of the dst vertex list
+            const IndexList &srcIndexData = _src.m_indexData[i][j];
+            U32 *indices = m_indexData[i][layerIndex * DrawPrimitive_Count + k].expand(srcIndexData.size());
+            for (U32 n = 0; n < srcIndexData.size(); ++n)
+            {
+                indices[n] = srcIndexData[n] + dstVertexData.size();
+            }
+#endif
+#if IM3D_VERTEX_COMPACT
+            // re-encode relative to this context's origin
+            const VertexList &srcVertexData = vertexData[j];
+            const Vec3 offset = _src.m_origin - m_origin;
+            DrawVertex *vertices = dstVertexData.expand(srcVertexData.size());
+            for (U32 n = 0; n < srcVertexData.size(); ++n)
+            {
+                const DrawVertex &v = srcVertexData[n];
+                vertices[n] = DrawVertex(v.getPosition() + offset, v.getSize(), v.m_color);
+            }
+#else
+            dstVertexData.append(vertexData[j]);
+#endif
+        }
+    }
+
+#if IM3D_CULL_PRIMITIVES
+    // cull records, rebased to the lists/ranges the data was appended to (which keeps them ordered within each list)
+    CullRecord *records = m_cullRecords.expand(_src.m_cullRecords.size());
+    for (U32 i = 0; i < _src.m_cullRecords.size(); ++i)
+    {
+        const CullRecord &src = _src.m_cullRecords[i];
+        const ListRebase &lr = rebase[src.m_vertexDataIndex * srcListCount + src.m_list];
+        CullRecord &dst = records[i];
+        dst.m_list = lr.m_list;
+        dst.m_vertexDataIndex = src.m_vertexDataIndex;
+        dst.m_firstVertex = src.m_firstVertex + lr.m_firstVertex;
+        dst.m_endVertex = src.m_endVertex + lr.m_firstVertex;
+        dst.m_firstIndex = src.m_firstIndex + lr.m_firstIndex;
+        dst.m_endIndex = src.m_endIndex + lr.m_firstIndex;
+    }
+    for (int i = 0; i < 6; ++i)
+    {
+        m_cullBounds[i].append(_src.m_cullBounds[i]);
+    }
+#endif
+}
+
+#if IM3D_CULL_PRIMITIVES
+void Context::cullPrimitives()
+{
+    const U32 recordCount = m_cullRecords.size();
+    if (recordCount == 0 || m_cullFrustumCount == 0)
+    {
+        return;
+    }
+    bool *visible = (bool *)m_frameArena.allocate(sizeof(bool) * recordCount, alignof(bool));
+    const float *const bounds[6] = {
+        m_cullBounds[0].data(), m_cullBounds[1].data(), m_cullBounds[2].data(),
+        m_cullBounds[3].data(), m_cullBounds[4].data(), m_cullBounds[5].data()};
+    CullBoxes(bounds, recordCount, m_cullFrustum, m_cullFrustumCount, visible);
+
+    // compact all lists in a single pass, the records are in submission order and hence ordered within each list
+    const U32 listCount = m_vertexData[0].size();
+    CullCursor *cursors = (CullCursor *)m_frameArena.allocate(sizeof(CullCursor) * listCount * 2, alignof(CullCursor));
+    memset(cursors, 0, sizeof(CullCursor) * listCount * 2);
+    for (U32 i = 0; i < recordCount; ++i)
+    {
+        const CullRecord &rec = m_cullRecords[i];
+        CullCursor &cursor = cursors[rec.m_vertexDataIndex * listCount + rec.m_list];
+        VertexList &vertexData = m_vertexData[rec.m_vertexDataIndex][rec.m_list];
+#if IM3D_INDEXED_PRIMITIVES
+        IndexList *indexData = &m_indexData[rec.m_vertexDataIndex][rec.m_list];
+#else
+        IndexList *indexData = nullptr;
+#endif
+        CullKeep(cursor, vertexData, rec.m_firstVertex, indexData, rec.m_firstIndex);
+        if (visible[i])
+        {
+            CullKeep(cursor, vertexData, rec.m_endVertex, indexData, rec.m_endIndex);
+        }
+        else
+        {
+            cursor.m_vertexRead = rec.m_endVertex;
+            cursor.m_indexRead = rec.m_endIndex;
+        }
+    }
+    for (U32 i = 0; i < listCount * 2; ++i)
+    {
+        CullCursor &cursor = cursors[i];
+        if (cursor.m_vertexRead == cursor.m_vertexWrite && cursor.m_indexRead == cursor.m_indexWrite)
+        {
+            continue; // nothing culled
+        }
+        VertexList &vertexData = m_vertexData[i / listCount][i % listCount];
+#if IM3D_INDEXED_PRIMITIVES
+        IndexList *indexData = &m_indexData[i / listCount][i % listCount];
+        CullKeep(cursor, vertexData, vertexData.size(), indexData, indexData->size());
+        indexData->resize(cursor.m_indexWrite, 0);
+#else
+        CullKeep(cursor, vertexData, vertexData.size(), (IndexList *)nullptr, 0);
+#endif
+        vertexData.resize(cursor.m_vertexWrite, DrawVertex());
+    }
+}
+#endif // IM3D_CULL_PRIMITIVES
+
+#if IM3D_CULL_DRAW_PRIMITIVES
+void Context::cullDrawPrimitives()
+{
+    if (m_cullFrustumCount == 0)
+    {
+        return;
+    }
+#if IM3D_VERTEX_COMPACT
+    // draw vertex positions are relative to m_origin, move the planes and view origin instead of the vertices
+    Vec4 planes[FrustumPlane_Count];
+    for (int i = 0; i < m_cullFrustumCount; ++i)
+    {
+        const Vec4 &plane = m_cullFrustum[i];
+        planes[i] = Vec4(plane.x, plane.y, plane.z, plane.w - Dot(Vec3(plane), m_origin));
+    }
+    const Vec3 viewOrigin = m_appData.m_viewOrigin - m_origin;
+#else
+    const Vec4 *planes = m_cullFrustum;
+    const Vec3 viewOrigin = m_appData.m_viewOrigin;
+#endif
+    const float pixelScale = m_appData.m_projScaleY / m_appData.m_viewportSize.y; // as per pixelsToWorldSize()
+
+    CullDrawBatch batch;
+    bool visible[kCullDrawBatchSize];
+    for (int vd = 0; vd < 2; ++vd)
+    {
+        for (U32 list = 0; list < m_vertexData[vd].size(); ++list)
+        {
+            const DrawPrimitiveType primType = (DrawPrimitiveType)(list % DrawPrimitive_Count);
+            const int vertsPerPrim = VertsPerDrawPrimitive[primType];
+            VertexList &vertexData = m_vertexData[vd][list];
+#if IM3D_INDEXED_PRIMITIVES
+            // primitives are defined by the index list, only indices are removed
+            IndexList &indexData = m_indexData[vd][list];
+            const U32 primCount = indexData.size() / vertsPerPrim;
+#else
+            // strips/loops were expanded to lists by end(), every vertsPerPrim vertices are a primitive
+            const U32 primCount = vertexData.size() / vertsPerPrim;
+#endif
+            U32 keepCount = 0;
+            for (U32 base = 0; base < primCount; base += kCullDrawBatchSize)
+            {
+                const U32 count = primCount - base < kCullDrawBatchSize ? primCount - base : kCullDrawBatchSize;
+                for (U32 i = 0; i < count; ++i)
+                {
+                    for (int j = 0; j < vertsPerPrim; ++j)
+                    {
+#if IM3D_INDEXED_PRIMITIVES
+                        const DrawVertex &v = vertexData[indexData[(base + i) * vertsPerPrim + j]];
+#else
+                        const DrawVertex &v = vertexData[(base + i) * vertsPerPrim + j];
+#endif
+#if IM3D_VERTEX_COMPACT
+                        const Vec3 position = v.getPosition();
+                        batch[j][3][i] = v.getSize();
+#else
+                        const Vec3 position = Vec3(v.m_positionSize);
+                        batch[j][3][i] = v.m_positionSize.w;
+#endif
+                        batch[j][0][i] = position.x;
+                        batch[j][1][i] = position.y;
+                        batch[j][2][i] = position.z;
+                    }
+                }
+                switch (primType)
+                {
+                case DrawPrimitive_Triangles:
+                    CullDrawPrimitives<3>(batch, count, planes, m_cullFrustumCount, viewOrigin, 0.0f, m_appData.m_projOrtho, visible);
+                    break;
+                case DrawPrimitive_Lines:
+                    CullDrawPrimitives<2>(batch, count, planes, m_cullFrustumCount, viewOrigin, pixelScale, m_appData.m_projOrtho, visible);
+                    break;
+                case DrawPrimitive_Points:
+                    CullDrawPrimitives<1>(batch, count, planes, m_cullFrustumCount, viewOrigin, pixelScale, m_appData.m_projOrtho, visible);
+                    break;
+                default:
+                    IM3D_ASSERT(false);
+                    break;
+                };
+
+                // compact in place, the write position never passes the read position
+                for (U32 i = 0; i < count; ++i)
+                {
+                    if (!visible[i])
+                    {
+                        continue;
+                    }
+                    const U32 src = (base + i) * vertsPerPrim;
+                    const U32 dst = keepCount * vertsPerPrim;
+                    if (src != dst)
+                    {
+                        for (int j = 0; j < vertsPerPrim; ++j)
+                        {
+#if IM3D_INDEXED_PRIMITIVES
+                            indexData[dst + j] = indexData[src + j];
+#else
+                            vertexData[dst + j] = vertexData[src + j];
+#endif
+                        }
+                    }
+                    ++keepCount;
+                }
+            }
+            m_cullDrawPrimitiveCount += primCount - keepCount;
+#if IM3D_INDEXED_PRIMITIVES
+            indexData.resize(keepCount * vertsPerPrim, 0);
+#else
+            vertexData.resize(keepCount * vertsPerPrim, DrawVertex());
+#endif
+        }
+    }
+}
+#endif // IM3D_CULL_DRAW_PRIMITIVES
+
+void Context::endFrame()
+{
+    IM3D_ASSERT(!m_endFrameCalled); // EndFrame() was called multiple times for this frame
+    m_endFrameCalled = true;
+
+#if IM3D_CULL_PRIMITIVES
+    cullPrimitives();
+#endif
+#if IM3D_CULL_DRAW_PRIMITIVES
+    cullDrawPrimitives();
+#endif
+
+    // draw unsorted primitives first
+    for (U32 i = 0; i < m_vertexData[0].size(); ++i)
+    {
+        if (m_vertexData[0][i].size() > 0)
+        {
+            DrawList dl;
+            dl.m_layerId = m_layerIdMap[i / DrawPrimitive_Count];
+            dl.m_primType = (DrawPrimitiveType)(i % DrawPrimitive_Count);
+            dl.m_vertexData = m_vertexData[0][i].data();
+            dl.m_vertexCount = m_vertexData[0][i].size();
+#if IM3D_VERTEX_COMPACT
+            dl.m_origin = m_origin;
+#endif
+#if IM3D_INDEXED_PRIMITIVES
+            dl.m_indexData = m_indexData[0][i].data();
+            dl.m_indexCount = m_indexData[0][i].size();
+#else
+            dl.m_indexData = nullptr;
+            dl.m_indexCount = 0;
+#endif
+            m_drawLists.push_back(dl);
+        }
+    }
+
+    // draw sorted primitives second
+    if (!m_sortCalled)
+    {
+        sort();
+    }
+}
+
+void Context::draw()
+{
+    if (m_drawLists.empty())
+    {
+        endFrame();
+    }
+
+    IM3D_ASSERT(m_appData.drawCallback);
+    for (auto &drawList : m_drawLists)
+    {
+        m_appData.drawCallback(drawList);
+    }
+}
+
+void Context::pushEnableSorting(bool _enable)
+{
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change sort mode mid-primitive
+    m_vertexDataIndex = _enable ? 1 : 0;
+    m_enableSortingStack.push_back(_enable);
+}
+void Context::popEnableSorting()
+{
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change sort mode mid-primitive
+    m_enableSortingStack.pop_back();
+    m_vertexDataIndex = m_enableSortingStack.back() ? 1 : 0;
+}
+void Context::setEnableSorting(bool _enable)
+{
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change sort mode mid-primitive
+    m_vertexDataIndex = _enable ? 1 : 0;
+    m_enableSortingStack.back() = _enable;
+}
+
+void Context::pushLayerId(Id _layer)
+{
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't change layer mid-primitive
+    int idx = findLayerIndex(_layer);
+    if (idx == -1)
+    { // not found, push new layer
+        idx = m_layerIdMap.size();
+        m_layerIdMap.push_back(_layer);
+        insertLayerHash(idx);
+        m_layerCacheIndex = idx;
+        for (int i = 0; i < DrawPrimitive_Count; ++i)
+        {
+            for (int j = 0; j < 2; ++j)
+            {
+                AddList(m_vertexData[j], m_frameArena.getAllocator());
+#if IM3D_INDEXED_PRIMITIVES
+                AddList(m_indexData[j], m_frameArena.getAllocator());
+#endif
+            }
+            AddList(m_sortOrder, &m_allocator); // persists between frames
+            m_sortHash.push_back(0);
+        }
+    }
+    m_layerIdStack.push_back(_layer);
+    m_layerIndexStack.push_back(idx);
+    m_layerIndex = idx;
+}
+void Context::popLayerId()
+{
+    IM3D_ASSERT(m_layerIdStack.size() > 1);
+    m_layerIdStack.pop_back();
+    m_layerIndexStack.pop_back();
+    m_layerIndex = m_layerIndexStack.back();
+}
+
+bool Context::pushCullBounds(const Vec3 &_min, const Vec3 &_max)
+{
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't push a cull scope mid-primitive
+    bool visible = m_cullScopeVisible;
+    if (visible && m_recordingIndex == -1 && (m_cullFrustumCount > 0 || m_occlusionEnabled))
+    {
+        // transform to world space as per vertex(), test the box which encloses the transformed box
+        Vec3 center = (_min + _max) * 0.5f;
+        Vec3 extents = (_max - _min) * 0.5f;
+        if (m_matrixStack.size() > 1)
+        {
+            const Mat4 &m = m_matrixStack.back();
+            center = m * center;
+            extents = Vec3(
+                fabsf(m(0, 0)) * extents.x + fabsf(m(0, 1)) * extents.y + fabsf(m(0, 2)) * extents.z,
+                fabsf(m(1, 0)) * extents.x + fabsf(m(1, 1)) * extents.y + fabsf(m(1, 2)) * extents.z,
+                fabsf(m(2, 0)) * extents.x + fabsf(m(2, 1)) * extents.y + fabsf(m(2, 2)) * extents.z);
+        }
+        visible = isVisible(center - extents, center + extents) && !isOccluded(center - extents, center + extents);
+    }
+    m_cullScopeStack.push_back(visible);
+    m_cullScopeVisible = visible;
+    return visible;
+}
+void Context::popCullBounds()
+{
+    IM3D_ASSERT(m_cullScopeStack.size() > 1);
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't pop a cull scope mid-primitive
+    m_cullScopeStack.pop_back();
+    m_cullScopeVisible = m_cullScopeStack.back();
+}
+
+void Context::beginRecording(Id _id)
+{
+    IM3D_ASSERT(m_recordingIndex == -1);           // recordings can't be nested
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't begin a recording mid-primitive
+    int index = -1;
+    for (U32 i = 0; i < m_recordingIds.size(); ++i)
+    {
+        if (m_recordingIds[i] == _id)
+        {
+            index = (int)i;
+            break;
+        }
+    }
+    if (index == -1)
+    {
+        index = (int)m_recordingIds.size();
+        m_recordingIds.push_back(_id);
+        for (int i = 0; i < DrawPrimitive_Count; ++i)
+        {
+            AddList(m_recordings, &m_allocator);
+        }
+    }
+    for (int i = 0; i < DrawPrimitive_Count; ++i)
+    {
+        m_recordings[index * DrawPrimitive_Count + i].clear();
+    }
+    m_recordingIndex = index;
+    // the recording isn't culled, even inside a culled scope; alpha is relative to the alpha passed to drawRecorded()
+    m_cullScopeStack.push_back(true);
+    m_cullScopeVisible = true;
+    pushAlpha(1.0f);
+}
+void Context::endRecording()
+{
+    IM3D_ASSERT(m_recordingIndex != -1);           // EndRecording() called without BeginRecording()
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't end a recording mid-primitive
+    popAlpha();
+    m_recordingIndex = -1;
+    popCullBounds();
+}
+void Context::drawRecorded(Id _id, const Mat4 *_transform)
+{
+    IM3D_ASSERT(m_recordingIndex == -1);           // DrawRecorded() called while recording
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // DrawRecorded() called mid-primitive
+    if (!m_cullScopeVisible)
+    {
+        return;
+    }
+    int index = -1;
+    for (U32 i = 0; i < m_recordingIds.size(); ++i)
+    {
+        if (m_recordingIds[i] == _id)
+        {
+            index = (int)i;
+            break;
+        }
+    }
+    if (index == -1)
+    {
+        return;
+    }
+
+    if (_transform)
+    {
+        pushMatrix(getMatrix() * *_transform);
+    }
+    // submit as per vertex(), copy a batch at a time so that flushVertices() transforms the vertices while they're in cache
+    static const PrimitiveMode kPrimitiveModes[DrawPrimitive_Count] = {PrimitiveMode_Triangles, PrimitiveMode_Lines, PrimitiveMode_Points};
+    for (int i = 0; i < DrawPrimitive_Count; ++i)
+    {
+        const Vector<VertexData> &recording = m_recordings[index * DrawPrimitive_Count + i];
+        if (recording.empty())
+        {
+            continue;
+        }
+        begin(kPrimitiveModes[i]);
+        for (U32 j = 0; j < recording.size(); j += VertexBatchSize)
+        {
+            const U32 count = recording.size() - j < VertexBatchSize ? recording.size() - j : VertexBatchSize;
+            memcpy(m_primVertices.expand(count), recording.data() + j, sizeof(VertexData) * count);
+            flushVertices();
+        }
+        end();
+    }
+    if (_transform)
+    {
+        popMatrix();
+    }
+}
+void Context::recordPrimitive()
+{
+    Vector<VertexData> &recording = m_recordings[m_recordingIndex * DrawPrimitive_Count + m_primType];
+    const VertexData *src = m_recordVertices.data();
+    const U32 count = m_recordVertices.size();
+    switch (m_primMode)
+    {
+    case PrimitiveMode_Points:
+    case PrimitiveMode_Lines:
+    case PrimitiveMode_Triangles:
+        IM3D_ASSERT(count % VertsPerDrawPrimitive[m_primType] == 0);
+        memcpy(recording.expand(count), src, sizeof(VertexData) * count);
+        break;
+    case PrimitiveMode_LineStrip:
+    case PrimitiveMode_LineLoop:
+    {
+        if (count < 2)
+        {
+            break;
+        }
+        const bool loop = m_primMode == PrimitiveMode_LineLoop;
+        VertexData *out = recording.expand((count - 1) * 2 + (loop ? 2 : 0));
+        for (U32 i = 1; i < count; ++i)
+        {
+            *out++ = src[i - 1];
+            *out++ = src[i];
+        }
+        if (loop)
+        {
+            *out++ = src[count - 1];
+            *out++ = src[0];
+        }
+        break;
+    }
+    case PrimitiveMode_TriangleStrip:
+    {
+        if (count < 3)
+        {
+            break;
+        }
+        VertexData *out = recording.expand((count - 2) * 3);
+        for (U32 i = 2; i < count; ++i)
+        {
+            *out++ = src[i - 2];
+            *out++ = src[i - 1];
+            *out++ = src[i];
+        }
+        break;
+    }
+    default:
+        break;
+    };
+    m_recordVertices.clear();
+}
+
+void *Context::HeapAlloc(size_t _size, size_t _align, void *_userData)
+{
+    Context *ctx = (Context *)_userData;
+    ++ctx->m_heapAllocCount;
+    return ctx->m_parentAllocator.m_alloc(_size, _align, ctx->m_parentAllocator.m_userData);
+}
+void Context::HeapFree(void *_ptr, void *_userData)
+{
+    Context *ctx = (Context *)_userData;
+    ++ctx->m_heapFreeCount;
+    ctx->m_parentAllocator.m_free(_ptr, ctx->m_parentAllocator.m_userData);
+}
+
+Context::Context(const Allocator *_allocator)
+{
+    m_parentAllocator = GetAllocator(_allocator);
+    m_allocator.m_alloc = HeapAlloc;
+    m_allocator.m_free = HeapFree;
+    m_allocator.m_userData = this;
+    m_heapAllocCount = 0;
+    m_heapFreeCount = 0;
+    m_frameArena.init(&m_allocator);
+    m_colorStack.setAllocator(&m_allocator);
+    m_alphaStack.setAllocator(&m_allocator);
+    m_sizeStack.setAllocator(&m_allocator);
+    m_enableSortingStack.setAllocator(&m_allocator);
+    m_matrixStack.setAllocator(&m_allocator);
+    m_idStack.setAllocator(&m_allocator);
+    m_layerIdStack.setAllocator(&m_allocator);
+    m_cullScopeStack.setAllocator(&m_allocator);
+    m_layerIndexStack.setAllocator(&m_allocator);
+    for (int i = 0; i < 2; ++i)
+    {
+        m_vertexData[i].setAllocator(&m_allocator);
+        m_indexData[i].setAllocator(&m_allocator);
+    }
+    m_layerIdMap.setAllocator(&m_allocator);
+    m_sortOrder.setAllocator(&m_allocator);
+    m_unitCircles.setAllocator(&m_allocator);
+    m_lodHash[0].setAllocator(&m_allocator);
+    m_lodHash[1].setAllocator(&m_allocator);
+    m_lodHashIndex = 0;
+    m_lodCount = 0;
+    m_lodErrorScale = 1.0f;
+    m_recordingIds.setAllocator(&m_allocator);
+    m_recordings.setAllocator(&m_allocator);
+    m_recordVertices.setAllocator(&m_allocator);
+    m_recordingIndex = -1;
+    m_polylinePoints.setAllocator(&m_allocator);
+    m_polylinePixelSize.setAllocator(&m_allocator);
+    m_polylineIndices.setAllocator(&m_allocator);
+    m_polylineStack.setAllocator(&m_allocator);
+    m_polylineVertices.setAllocator(&m_allocator);
+    m_sortHash.setAllocator(&m_allocator);
+    m_layerHash.setAllocator(&m_allocator);
+    m_drawLists.setAllocator(&m_allocator);
+    m_primVertices.setAllocator(&m_allocator);
+    m_occlusionDepth.setAllocator(&m_allocator);
+    m_occlusionTestDepth.setAllocator(&m_allocator);
+    m_occlusionTileDepth.setAllocator(&m_allocator);
+#if IM3D_CULL_PRIMITIVES
+    m_cullRecords.setAllocator(m_frameArena.getAllocator());
+    for (int i = 0; i < 6; ++i)
+    {
+        m_cullBounds[i].setAllocator(m_frameArena.getAllocator());
+    }
+#endif
+#if IM3D_VERTEX_COMPACT
+    m_primDrawVertices.setAllocator(&m_allocator);
+#endif
+
+    m_sortCalled = false;
+    m_sortSkipCount = 0;
+    m_sortMergeCount = 0;
+    m_cullDrawPrimitiveCount = 0;
     m_endFrameCalled = false;
+    m_occlusionWidth = m_occlusionHeight = 0;
+    m_occlusionEnabled = false;
+    m_occlusionTestDirty = false;
+    m_occlusionVisibleMin = Vec3(FLT_MAX);
+    m_occlusionVisibleMax = Vec3(-FLT_MAX);
     m_primMode = PrimitiveMode_None;
     m_vertexDataIndex = 0; // = sorting disabled
+    m_layerCacheIndex = -1;
     m_layerIndex = 0;
     m_firstVertThisPrim = 0;
     m_vertCountThisPrim = 0;
+    m_firstIndexThisPrim = 0;
+    m_reservedThisPrim = false;
+#if IM3D_VERTEX_COMPACT
+    m_origin = Vec3(0.0f);
+#endif
 
     m_gizmoLocal = false;
     m_gizmoMode = GizmoMode_Translation;
@@ -1739,191 +3823,711 @@ Context::Context()
     m_gizmoHeightPixels = 64.0f;
     m_gizmoSizePixels = 5.0f;
 
-    memset(&m_appData, 0, sizeof(m_appData));
-    memset(&m_keyDownCurr, 0, sizeof(m_keyDownCurr));
-    memset(&m_keyDownPrev, 0, sizeof(m_keyDownPrev));
+    memset(&m_appData, 0, sizeof(m_appData));
+    memset(&m_keyDownCurr, 0, sizeof(m_keyDownCurr));
+    memset(&m_keyDownPrev, 0, sizeof(m_keyDownPrev));
+
+    // init cull frustum to INF effectively disables culling
+    for (int i = 0; i < FrustumPlane_Count; ++i)
+    {
+        m_appData.m_cullFrustum[i] = Vec4(INFINITY);
+    }
+
+    pushMatrix(Mat4(1.0f));
+    pushColor(Color_White);
+    pushAlpha(1.0f);
+    pushSize(1.0f);
+    pushEnableSorting(false);
+    pushLayerId(0);
+    pushId(0x811C9DC5u); // fnv1 hash base
+    m_cullScopeStack.push_back(true);
+    m_cullScopeVisible = true;
+}
+
+Context::~Context()
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        // Vector doesn't call element dtors
+        for (VertexList &vertexList : m_vertexData[i])
+        {
+            vertexList.~Vector();
+        }
+        for (IndexList &indexList : m_indexData[i])
+        {
+            indexList.~Vector();
+        }
+    }
+    for (IndexList &sortOrder : m_sortOrder)
+    {
+        sortOrder.~Vector();
+    }
+    for (Vector<Vec2> &circle : m_unitCircles)
+    {
+        circle.~Vector();
+    }
+    for (Vector<VertexData> &recording : m_recordings)
+    {
+        recording.~Vector();
+    }
+}
+
+namespace
+{
+struct SortData
+{
+    float m_key;
+    U32 m_prim; // Index of the primitive in the list.
+    SortData() {}
+    SortData(float _key, U32 _prim) : m_key(_key), m_prim(_prim) {}
+};
+
+// Map _f to an unsigned int with the same ordering (flip all bits of negative values, else flip the sign bit).
+inline U32 FloatToSortKey(float _f)
+{
+    U32 u;
+    memcpy(&u, &_f, sizeof(u));
+    return u ^ ((U32)((int)u >> 31) | 0x80000000u);
+}
+
+// Stable LSD radix sort of _data_ by descending m_key, 8 bits per pass. _scratch must have space for _count elements.
+void RadixSortDescending(SortData *_data_, SortData *_scratch, U32 _count)
+{
+    U32 histogram[4][256];
+    memset(histogram, 0, sizeof(histogram));
+    for (U32 i = 0; i < _count; ++i)
+    {
+        U32 key = ~FloatToSortKey(_data_[i].m_key); // invert for descending order
+        ++histogram[0][key & 0xff];
+        ++histogram[1][(key >> 8) & 0xff];
+        ++histogram[2][(key >> 16) & 0xff];
+        ++histogram[3][key >> 24];
+    }
+
+    SortData *src = _data_;
+    SortData *dst = _scratch;
+    for (U32 pass = 0; pass < 4; ++pass)
+    {
+        const U32 shift = pass * 8;
+        U32 *offsets = histogram[pass];
+        if (offsets[(~FloatToSortKey(src[0].m_key) >> shift) & 0xff] == _count)
+        { // all keys have the same digit, this pass wouldn't change the order
+            continue;
+        }
+        U32 offset = 0;
+        for (U32 i = 0; i < 256; ++i)
+        {
+            U32 count = offsets[i];
+            offsets[i] = offset;
+            offset += count;
+        }
+        for (U32 i = 0; i < _count; ++i)
+        {
+            U32 digit = (~FloatToSortKey(src[i].m_key) >> shift) & 0xff;
+            dst[offsets[digit]++] = src[i];
+        }
+        SortData *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != _data_)
+    {
+        memcpy(_data_, src, sizeof(SortData) * _count);
+    }
+}
+
+// Stable counting sort of _data_ by descending m_key, where each m_key is an integer in [0, _bucketCount). _counts must have space
+// for _bucketCount elements.
+void CountingSortDescending(SortData *_data_, SortData *_scratch, U32 _count, U32 *_counts, U32 _bucketCount)
+{
+    memset(_counts, 0, sizeof(U32) * _bucketCount);
+    for (U32 i = 0; i < _count; ++i)
+    {
+        ++_counts[(U32)_data_[i].m_key];
+    }
+    U32 offset = 0;
+    for (U32 i = _bucketCount; i > 0; --i)
+    {
+        U32 count = _counts[i - 1];
+        _counts[i - 1] = offset;
+        offset += count;
+    }
+    for (U32 i = 0; i < _count; ++i)
+    {
+        _scratch[_counts[(U32)_data_[i].m_key]++] = _data_[i];
+    }
+    memcpy(_data_, _scratch, sizeof(SortData) * _count);
+}
+
+// FNV-1a, used to detect unchanged sort keys between frames.
+const U64 kFnv64Basis = 0xcbf29ce484222325ull;
+const U64 kFnv64Prime = 0x100000001b3ull;
+
+// Near plane distance relative to the far plane for AppData::m_sortBucketCount, if the near plane isn't usable (e.g. ortho).
+const float kSortBucketMinNearRatio = 1.0f / 1024.0f;
+
+// Gather _src (vertices or indices) into _dst_ per _sort, copying whole primitives. _dst_ must already have the size of _src, such
+// that this doesn't allocate (it runs in the sort tasks).
+template <typename T, U32 kPrimSize>
+void Reorder(Vector<T> &_dst_, const Vector<T> &_src, const SortData *_sort, U32 _sortCount)
+{
+    IM3D_ASSERT(_src.size() == _sortCount * kPrimSize);
+    IM3D_ASSERT(_dst_.size() == _src.size());
+    struct Prim
+    {
+        T m_data[kPrimSize];
+    };
+    Prim *dst = (Prim *)_dst_.data();
+    const Prim *src = (const Prim *)_src.data();
+    for (U32 i = 0; i < _sortCount; ++i)
+    {
+        dst[i] = src[_sort[i].m_prim];
+    }
+}
+template <typename T>
+void Reorder(Vector<T> &_dst_, const Vector<T> &_src, const SortData *_sort, U32 _sortCount, U32 _primSize)
+{
+    switch (_primSize)
+    {
+    case 1:
+        Reorder<T, 1>(_dst_, _src, _sort, _sortCount);
+        break;
+    case 2:
+        Reorder<T, 2>(_dst_, _src, _sort, _sortCount);
+        break;
+    case 3:
+        Reorder<T, 3>(_dst_, _src, _sort, _sortCount);
+        break;
+    default:
+        IM3D_ASSERT(false);
+        break;
+    };
+}
+// Run of consecutive primitives of the same type in a layer's sorted order, becomes one DrawList.
+struct SortRun
+{
+    U32 m_primType;
+    U32 m_primCount;
+};
+
+// Partition the sorted lists [_begin[i], _end[i]) into non-overlapping runs, write them to _runs_ (if not null) and return the
+// run count. The current run continues while its next key is >= the max key * _mergeScale - _mergeBias (i.e. primitives of
+// different types may be drawn out of order within that tolerance); 1 and 0 give the exact order.
+U32 PartitionRuns(SortData *const _begin[DrawPrimitive_Count], SortData *const _end[DrawPrimitive_Count], float _mergeScale, float _mergeBias, SortRun *_runs_)
+{
+    U32 runCount = 0;
+    int runPrim = -1;
+    int cprim = 0;
+    SortData *search[DrawPrimitive_Count];
+    int emptyCount = 0;
+    for (int i = 0; i < DrawPrimitive_Count; ++i)
+    {
+        search[i] = _begin[i];
+        if (search[i] == _end[i])
+        {
+            search[i] = 0;
+            ++emptyCount;
+        }
+    }
+#define modinc(v) ((v + 1) % DrawPrimitive_Count)
+    while (emptyCount != DrawPrimitive_Count)
+    {
+        while (search[cprim] == 0)
+        {
+            cprim = modinc(cprim);
+        }
+        // find the max key at the current position across all sort data
+        float mxkey = search[cprim]->m_key;
+        int mxprim = cprim;
+        for (int p = modinc(cprim); p != cprim; p = modinc(p))
+        {
+            if (search[p] != 0 && search[p]->m_key > mxkey)
+            {
+                mxkey = search[p]->m_key;
+                mxprim = p;
+            }
+        }
+        if (cprim == runPrim && search[cprim]->m_key >= mxkey * _mergeScale - _mergeBias)
+        {
+            mxprim = cprim;
+        }
+
+        // if the run is empty or the primitive changed, start a new run
+        if (runPrim != mxprim)
+        {
+            cprim = mxprim;
+            runPrim = mxprim;
+            if (_runs_)
+            {
+                _runs_[runCount].m_primType = (U32)cprim;
+                _runs_[runCount].m_primCount = 0;
+            }
+            ++runCount;
+        }
+
+        if (_runs_)
+        {
+            ++_runs_[runCount - 1].m_primCount;
+        }
+        ++search[cprim];
+        if (search[cprim] == _end[cprim])
+        {
+            search[cprim] = 0;
+            ++emptyCount;
+        }
+    }
+#undef modinc
+    return runCount;
+}
+
+// Call _task for each index in [0, _count), via AppData::parallelForCallback if set.
+void ParallelFor(const AppData &_appData, U32 _count, ParallelTaskCallback *_task, void *_taskData)
+{
+    if (_appData.parallelForCallback && _count > 1)
+    {
+        _appData.parallelForCallback(_count, _task, _taskData);
+    }
+    else
+    {
+        for (U32 i = 0; i < _count; ++i)
+        {
+            _task(i, _taskData);
+        }
+    }
+}
+} // namespace
+
+// Per-frame state for sort(). Everything is allocated before the tasks run, such that the tasks don't allocate (the frame arena
+// isn't thread safe) and only write to their own list/layer.
+struct Context::SortState
+{
+#if IM3D_INDEXED_PRIMITIVES
+    typedef IndexList SortedList;  // Only the index lists are reordered.
+#else
+    typedef VertexList SortedList;
+#endif
+
+    Context *m_context;
+    Vec3 m_viewOrigin;       // Relative to m_origin if IM3D_VERTEX_COMPACT.
+    U32 *m_listOffset;       // Index of the first primitive of each list in m_sortData, the last element is the total.
+    SortData *m_sortData;    // Sort data for all lists, list i starts at m_listOffset[i].
+    SortData *m_sortScratch; //                 "
+    SortRun *m_runs;         // Draw list runs per layer, layer i starts at m_listOffset[i * DrawPrimitive_Count].
+    U32 *m_runCount;         // # runs per layer.
+    bool *m_skipped;         // Per list, if the previous frame's order was reused.
+    SortedList *m_sorted;    // Per list, Reorder() destination, swapped into m_indexData[1]/m_vertexData[1] after the tasks.
+
+    // approximate sorting (AppData::m_sortBucketCount)
+    U32 m_bucketCount;       // 0 = exact sort.
+    U32 *m_bucketCounts;     // Counting sort histogram per list, list i starts at i * m_bucketCount.
+    int m_bucketKeyMin;      // FloatToSortKey() of the squared near plane distance, the first bucket.
+    float m_bucketScale;     // Converts a sort key relative to m_bucketKeyMin to a bucket index.
+
+    // draw list merging (AppData::m_sortMergeTolerance), see PartitionRuns()
+    float m_mergeScale;
+    float m_mergeBias;
+    U32 *m_mergeCount;       // # runs removed by merging per layer.
+};
+
+void Context::SortListTask(U32 _list, void *_state)
+{
+    SortState &state = *(SortState *)_state;
+    state.m_context->sortList(state, _list);
+}
+
+void Context::PartitionLayerTask(U32 _layer, void *_state)
+{
+    SortState &state = *(SortState *)_state;
+    state.m_context->partitionLayer(state, _layer);
+}
+
+void Context::sortList(SortState &_state, U32 _list)
+{
+    const int primType = (int)(_list % DrawPrimitive_Count);
+    const U32 primCount = _state.m_listOffset[_list + 1] - _state.m_listOffset[_list];
+    _state.m_skipped[_list] = false;
+    if (primCount == 0)
+    {
+        return;
+    }
+    SortData *sortData = _state.m_sortData + _state.m_listOffset[_list];
+    SortData *sortScratch = _state.m_sortScratch + _state.m_listOffset[_list];
+    const Vec3 viewOrigin = _state.m_viewOrigin;
+
+    VertexList &vertexData = m_vertexData[1][_list];
+#if IM3D_INDEXED_PRIMITIVES
+    // primitives are defined by the index list, vertices are never moved
+    IndexList &indexData = m_indexData[1][_list];
+    const U32 *primIndex = indexData.begin();
+#endif
+    U64 hash = kFnv64Basis ^ primCount;
+    for (U32 prim = 0; prim < primCount; ++prim)
+    {
+        SortData &sd = sortData[prim];
+        sd = SortData(0.0f, prim);
+        for (int j = 0; j < VertsPerDrawPrimitive[primType]; ++j)
+        {
+#if IM3D_INDEXED_PRIMITIVES
+            const DrawVertex &v = vertexData[*primIndex++];
+#else
+            const DrawVertex &v = vertexData[prim * VertsPerDrawPrimitive[primType] + j];
+#endif
+            // sort key is the primitive midpoint distance to view origin
+#if IM3D_VERTEX_COMPACT
+            sd.m_key += Length2(v.getPosition() - viewOrigin);
+#else
+            sd.m_key += Length2(Vec3(v.m_positionSize) - viewOrigin);
+#endif
+        }
+        sd.m_key /= (float)VertsPerDrawPrimitive[primType];
+        if (_state.m_bucketCount > 0)
+        {
+            // the sort key bits are a piecewise linear approximation of log2(m_key), buckets are therefore logarithmic in depth
+            float bucket = (float)((int)FloatToSortKey(sd.m_key) - _state.m_bucketKeyMin) * _state.m_bucketScale;
+            bucket = bucket < 0.0f ? 0.0f : bucket;
+            bucket = bucket > (float)(_state.m_bucketCount - 1) ? (float)(_state.m_bucketCount - 1) : bucket;
+            sd.m_key = floorf(bucket);
+        }
+        hash = (hash ^ FloatToSortKey(sd.m_key)) * kFnv64Prime;
+    }
+
+    IndexList &sortOrder = m_sortOrder[_list];
+    if (sortOrder.size() == primCount && m_sortHash[_list] == hash)
+    {
+        // the keys didn't change (e.g. a static view of static primitives), hence the previous order is still valid
+        for (U32 k = 0; k < primCount; ++k)
+        {
+            sortScratch[k] = sortData[sortOrder[k]];
+        }
+        memcpy(sortData, sortScratch, sizeof(SortData) * primCount);
+        _state.m_skipped[_list] = true;
+    }
+    else
+    {
+        if (_state.m_bucketCount > 0)
+        {
+            CountingSortDescending(sortData, sortScratch, primCount, _state.m_bucketCounts + _list * _state.m_bucketCount, _state.m_bucketCount);
+        }
+        else
+        {
+            // stable, so that primitives with equal keys keep their submission order between frames
+            RadixSortDescending(sortData, sortScratch, primCount);
+        }
+
+        // store the order for the next frame, sort() reserved the capacity
+        sortOrder.clear();
+        U32 *order = sortOrder.expand(primCount);
+        for (U32 k = 0; k < primCount; ++k)
+        {
+            order[k] = sortData[k].m_prim;
+        }
+        m_sortHash[_list] = hash;
+    }
+#if IM3D_INDEXED_PRIMITIVES
+    Reorder(_state.m_sorted[_list], indexData, sortData, primCount, VertsPerDrawPrimitive[primType]);
+#else
+    Reorder(_state.m_sorted[_list], vertexData, sortData, primCount, VertsPerDrawPrimitive[primType]);
+#endif
+}
+
+void Context::partitionLayer(SortState &_state, U32 _layer)
+{
+    const U32 firstList = _layer * DrawPrimitive_Count;
+    SortData *begin[DrawPrimitive_Count];
+    SortData *end[DrawPrimitive_Count];
+    for (int i = 0; i < DrawPrimitive_Count; ++i)
+    {
+        begin[i] = _state.m_sortData + _state.m_listOffset[firstList + i];
+        end[i] = _state.m_sortData + _state.m_listOffset[firstList + i + 1];
+    }
+    SortRun *runs = _state.m_runs + _state.m_listOffset[firstList];
+    _state.m_runCount[_layer] = PartitionRuns(begin, end, _state.m_mergeScale, _state.m_mergeBias, runs);
+    _state.m_mergeCount[_layer] = 0;
+    if (_state.m_mergeScale != 1.0f || _state.m_mergeBias != 0.0f)
+    {
+        // count the runs without merging for getSortMergeCount()
+        _state.m_mergeCount[_layer] = PartitionRuns(begin, end, 1.0f, 0.0f, nullptr) - _state.m_runCount[_layer];
+    }
+}
+
+void Context::sort()
+{
+    const U32 layerCount = m_layerIdMap.size();
+    const U32 listCount = layerCount * DrawPrimitive_Count;
+    IM3D_ASSERT(m_vertexData[1].size() == listCount);
+
+    SortState state;
+    state.m_context = this;
+    state.m_viewOrigin = m_appData.m_viewOrigin;
+#if IM3D_VERTEX_COMPACT
+    state.m_viewOrigin = state.m_viewOrigin - m_origin; // vertex positions are relative to m_origin
+#endif
+    state.m_listOffset = (U32 *)m_frameArena.allocate(sizeof(U32) * (listCount + 1), alignof(U32));
+    U32 totalPrimCount = 0;
+    for (U32 list = 0; list < listCount; ++list)
+    {
+        state.m_listOffset[list] = totalPrimCount;
+#if IM3D_INDEXED_PRIMITIVES
+        const U32 primCount = m_indexData[1][list].size() / VertsPerDrawPrimitive[list % DrawPrimitive_Count];
+#else
+        const U32 primCount = m_vertexData[1][list].size() / VertsPerDrawPrimitive[list % DrawPrimitive_Count];
+#endif
+        totalPrimCount += primCount;
+
+        // sortList() can't allocate, reserve space for the sort order here (the previous order is only useful if the count matches)
+        IndexList &sortOrder = m_sortOrder[list];
+        if (sortOrder.size() != primCount)
+        {
+            sortOrder.clear();
+            sortOrder.reserve(primCount);
+        }
+    }
+    state.m_listOffset[listCount] = totalPrimCount;
+    if (totalPrimCount == 0)
+    {
+        m_sortCalled = true;
+        return;
+    }
+    state.m_sortData = (SortData *)m_frameArena.allocate(sizeof(SortData) * totalPrimCount, alignof(SortData));
+    state.m_sortScratch = (SortData *)m_frameArena.allocate(sizeof(SortData) * totalPrimCount, alignof(SortData));
+    state.m_runs = (SortRun *)m_frameArena.allocate(sizeof(SortRun) * totalPrimCount, alignof(SortRun));
+    state.m_runCount = (U32 *)m_frameArena.allocate(sizeof(U32) * layerCount, alignof(U32));
+    state.m_skipped = (bool *)m_frameArena.allocate(sizeof(bool) * listCount, alignof(bool));
+    state.m_sorted = (SortState::SortedList *)m_frameArena.allocate(sizeof(SortState::SortedList) * listCount, alignof(SortState::SortedList));
+    for (U32 list = 0; list < listCount; ++list)
+    {
+        SortState::SortedList *sorted = new (&state.m_sorted[list]) SortState::SortedList();
+        sorted->setAllocator(m_frameArena.getAllocator());
+        const U32 primCount = state.m_listOffset[list + 1] - state.m_listOffset[list];
+        if (primCount > 0)
+        {
+            sorted->expand(primCount * VertsPerDrawPrimitive[list % DrawPrimitive_Count]);
+        }
+    }
+
+    state.m_bucketCount = 0;
+    state.m_bucketCounts = nullptr;
+    if (m_appData.m_sortBucketCount > 0)
+    {
+        // log buckets need a finite depth range, use the near/far cull planes (keys beyond the range go to the first/last bucket)
+        const float farDist = Distance(m_appData.m_cullFrustum[FrustumPlane_Far], m_appData.m_viewOrigin);
+        float nearDist = -Distance(m_appData.m_cullFrustum[FrustumPlane_Near], m_appData.m_viewOrigin);
+        if (m_appData.m_projOrtho || !(nearDist > 0.0f && nearDist < farDist))
+        {
+            nearDist = farDist * kSortBucketMinNearRatio;
+        }
+        if (farDist > 0.0f && farDist < FLT_MAX)
+        {
+            const int keyMin = (int)FloatToSortKey(nearDist * nearDist);
+            const int keyMax = (int)FloatToSortKey(farDist * farDist);
+            state.m_bucketCount = m_appData.m_sortBucketCount;
+            state.m_bucketCounts = (U32 *)m_frameArena.allocate(sizeof(U32) * listCount * state.m_bucketCount, alignof(U32));
+            state.m_bucketKeyMin = keyMin;
+            state.m_bucketScale = (float)state.m_bucketCount / (float)(keyMax - keyMin);
+        }
+    }
 
-    // init cull frustum to INF effectively disables culling
-    for (int i = 0; i < FrustumPlane_Count; ++i)
+    // the merge tolerance is a relative distance, sort keys are squared distances (or bucket indices)
+    state.m_mergeScale = 1.0f;
+    state.m_mergeBias = 0.0f;
+    state.m_mergeCount = (U32 *)m_frameArena.allocate(sizeof(U32) * layerCount, alignof(U32));
+    if (m_appData.m_sortMergeTolerance > 0.0f)
     {
-        m_appData.m_cullFrustum[i] = Vec4(INFINITY);
+        float scale = 1.0f - m_appData.m_sortMergeTolerance;
+        scale = scale < 0.0f ? 0.0f : scale * scale;
+        if (state.m_bucketCount > 0)
+        {
+            // log buckets, convert the ratio to a number of buckets
+            state.m_mergeBias = scale > 0.0f ? (float)(int)(FloatToSortKey(1.0f) - FloatToSortKey(scale)) * state.m_bucketScale : (float)state.m_bucketCount;
+        }
+        else
+        {
+            state.m_mergeScale = scale;
+        }
     }
 
-    pushMatrix(Mat4(1.0f));
-    pushColor(Color_White);
-    pushAlpha(1.0f);
-    pushSize(1.0f);
-    pushEnableSorting(false);
-    pushLayerId(0);
-    pushId(0x811C9DC5u); // fnv1 hash base
-}
+    // sort each primitive list internally, then partition each layer; lists/layers are independent
+    ParallelFor(m_appData, listCount, &SortListTask, &state);
+    ParallelFor(m_appData, layerCount, &PartitionLayerTask, &state);
+    for (U32 list = 0; list < listCount; ++list)
+    {
+        m_sortSkipCount += state.m_skipped[list] ? 1 : 0;
 
-Context::~Context()
-{
-    for (int i = 0; i < 2; ++i)
+        // swap in the reordered list, the old data is reclaimed by the next reset
+        if (state.m_listOffset[list + 1] > state.m_listOffset[list])
+        {
+#if IM3D_INDEXED_PRIMITIVES
+            IndexList::swap(m_indexData[1][list], state.m_sorted[list]);
+#else
+            VertexList::swap(m_vertexData[1][list], state.m_sorted[list]);
+#endif
+        }
+        state.m_sorted[list].~Vector();
+    }
+    for (U32 layer = 0; layer < layerCount; ++layer)
     {
-        while (!m_vertexData[i].empty())
+        m_sortMergeCount += state.m_mergeCount[layer];
+    }
+
+    // construct draw lists in layer order, such that the result doesn't depend on how the tasks were scheduled
+    for (U32 layer = 0; layer < layerCount; ++layer)
+    {
+        const SortRun *runs = state.m_runs + state.m_listOffset[layer * DrawPrimitive_Count];
+        U32 firstPrim[DrawPrimitive_Count] = {};
+        for (U32 r = 0; r < state.m_runCount[layer]; ++r)
         {
-            m_vertexData[i].back()->~Vector(); // manually call dtor (vector is allocated via IM3D_MALLOC during pushLayerId)
-            IM3D_FREE(m_vertexData[i].back());
-            m_vertexData[i].pop_back();
+            const int cprim = (int)runs[r].m_primType;
+            const U32 list = layer * DrawPrimitive_Count + cprim;
+            DrawList dl;
+            dl.m_layerId = layer;
+            dl.m_primType = (DrawPrimitiveType)cprim;
+#if IM3D_INDEXED_PRIMITIVES
+            // indices are relative to the start of the vertex list, the draw list references all of it
+            dl.m_vertexData = m_vertexData[1][list].data();
+            dl.m_vertexCount = m_vertexData[1][list].size();
+            dl.m_indexData = m_indexData[1][list].data() + firstPrim[cprim] * VertsPerDrawPrimitive[cprim];
+            dl.m_indexCount = runs[r].m_primCount * VertsPerDrawPrimitive[cprim];
+#else
+            dl.m_vertexData = m_vertexData[1][list].data() + firstPrim[cprim] * VertsPerDrawPrimitive[cprim];
+            dl.m_vertexCount = runs[r].m_primCount * VertsPerDrawPrimitive[cprim];
+            dl.m_indexData = nullptr;
+            dl.m_indexCount = 0;
+#endif
+#if IM3D_VERTEX_COMPACT
+            dl.m_origin = m_origin;
+#endif
+            m_drawLists.push_back(dl);
+            firstPrim[cprim] += runs[r].m_primCount;
         }
     }
+
+    m_sortCalled = true;
 }
 
 namespace
 {
-struct SortData
+// Layer ids may be small integers, mix the bits before masking.
+inline U32 HashLayerId(Id _id)
 {
-    float m_key;
-    VertexData *m_start;
-    SortData() {}
-    SortData(float _key, VertexData *_start) : m_key(_key), m_start(_start) {}
-};
+    U32 h = _id * 0x9e3779b1u;
+    return h ^ (h >> 16);
+}
+// Key for m_lodHash: the current id and the shape's local position/size, such that a shape keeps its key when other shapes are
+// culled or added before it. 0 is reserved for empty slots.
+inline U32 LodKey(Id _id, const Vec3 &_position, float _worldSize)
+{
+    const float params[4] = { _position.x, _position.y, _position.z, _worldSize };
+    U32 h = HashLayerId(_id);
+    for (float f : params)
+    {
+        U32 bits;
+        memcpy(&bits, &f, sizeof(bits));
+        h = HashLayerId(h ^ bits);
+    }
+    return h == 0 ? 1 : h;
+}
+} // namespace
 
-int SortCmp(const void *_a, const void *_b)
+int Context::findLayerIndex(Id _id) const
 {
-    float ka = ((SortData *)_a)->m_key;
-    float kb = ((SortData *)_b)->m_key;
-    if (ka < kb)
+    // layers are typically pushed repeatedly around each entity, check the most recent result first
+    if (m_layerCacheIndex >= 0 && m_layerIdMap[m_layerCacheIndex] == _id)
     {
-        return 1;
+        return m_layerCacheIndex;
     }
-    else if (ka > kb)
+    if (m_layerHash.empty())
     {
         return -1;
     }
-    else
+    const U32 mask = m_layerHash.size() - 1;
+    for (U32 slot = HashLayerId(_id) & mask;; slot = (slot + 1) & mask)
     {
-        return 0;
+        U32 idx = m_layerHash[slot];
+        if (idx == 0)
+        {
+            return -1;
+        }
+        if (m_layerIdMap[idx - 1] == _id)
+        {
+            m_layerCacheIndex = (int)idx - 1;
+            return m_layerCacheIndex;
+        }
     }
 }
 
-void Reorder(Vector<VertexData> &_data_, const SortData *_sort, U32 _sortCount, U32 _primSize)
+void Context::insertLayerHash(U32 _layerIndex)
 {
-    Vector<VertexData> ret;
-    ret.reserve(_data_.size());
-    for (U32 i = 0; i < _sortCount; ++i)
+    // keep the load factor <= 1/2, rehash all layers when growing
+    U32 first = _layerIndex;
+    if (m_layerIdMap.size() * 2 > m_layerHash.size())
+    {
+        U32 size = m_layerHash.empty() ? 16 : m_layerHash.size() * 2;
+        m_layerHash.clear();
+        m_layerHash.resize(size, 0);
+        first = 0;
+    }
+    const U32 mask = m_layerHash.size() - 1;
+    for (U32 i = first; i <= _layerIndex; ++i)
     {
-        for (U32 j = 0; j < _primSize; ++j)
+        U32 slot = HashLayerId(m_layerIdMap[i]) & mask;
+        while (m_layerHash[slot] != 0)
         {
-            ret.push_back(*(_sort[i].m_start + j));
+            slot = (slot + 1) & mask;
         }
+        m_layerHash[slot] = i + 1;
     }
-    Vector<VertexData>::swap(_data_, ret);
 }
-} // namespace
 
-void Context::sort()
+int Context::findLodDetail(U32 _table, U32 _key) const
 {
-    static IM3D_THREAD_LOCAL Vector<SortData> sortData[DrawPrimitive_Count]; // reduces # allocs
-
-    for (U32 layer = 0; layer < m_layerIdMap.size(); ++layer)
+    const Vector<LodEntry> &table = m_lodHash[_table];
+    if (table.empty())
     {
-        Vec3 viewOrigin = m_appData.m_viewOrigin;
-
-        // sort each primitive list internally
-        for (int i = 0; i < DrawPrimitive_Count; ++i)
-        {
-            Vector<VertexData> &vertexData = *(m_vertexData[1][layer * DrawPrimitive_Count + i]);
-            sortData[i].clear();
-            if (!vertexData.empty())
-            {
-                sortData[i].reserve(vertexData.size() / VertsPerDrawPrimitive[i]);
-                for (VertexData *v = vertexData.begin(); v != vertexData.end();)
-                {
-                    sortData[i].push_back(SortData(0.0f, v));
-                    IM3D_ASSERT(v < vertexData.end());
-                    for (int j = 0; j < VertsPerDrawPrimitive[i]; ++j, ++v)
-                    {
-                        // sort key is the primitive midpoint distance to view origin
-                        sortData[i].back().m_key += Length2(Vec3(v->m_positionSize) - viewOrigin);
-                    }
-                    sortData[i].back().m_key /= (float)VertsPerDrawPrimitive[i];
-                }
-                // qsort is not necessarily stable but it doesn't matter assuming the prims are pushed in roughly the same order each frame
-                qsort(sortData[i].data(), sortData[i].size(), sizeof(SortData), SortCmp);
-                Reorder(vertexData, sortData[i].data(), sortData[i].size(), VertsPerDrawPrimitive[i]);
-            }
-        }
-
-        // construct draw lists - partition sort data into non-overlapping lists
-        int cprim = 0;
-        SortData *search[DrawPrimitive_Count];
-        int emptyCount = 0;
-        for (int i = 0; i < DrawPrimitive_Count; ++i)
+        return -1;
+    }
+    const U32 mask = table.size() - 1;
+    for (U32 slot = _key & mask;; slot = (slot + 1) & mask)
+    {
+        if (table[slot].m_key == 0)
         {
-            if (sortData[i].empty())
-            {
-                search[i] = 0;
-                ++emptyCount;
-            }
-            else
-            {
-                search[i] = sortData[i].begin();
-            }
+            return -1;
         }
-        bool first = true;
-#define modinc(v) ((v + 1) % DrawPrimitive_Count)
-        while (emptyCount != DrawPrimitive_Count)
+        if (table[slot].m_key == _key)
         {
-            while (search[cprim] == 0)
-            {
-                cprim = modinc(cprim);
-            }
-            // find the max key at the current position across all sort data
-            float mxkey = search[cprim]->m_key;
-            int mxprim = cprim;
-            for (int p = modinc(cprim); p != cprim; p = modinc(p))
-            {
-                if (search[p] != 0 && search[p]->m_key > mxkey)
-                {
-                    mxkey = search[p]->m_key;
-                    mxprim = p;
-                }
-            }
-
-            // if draw list is empty or the layer or primitive changed, start a new draw list
-            if (
-                first ||
-                m_drawLists.back().m_layerId != layer ||
-                m_drawLists.back().m_primType != mxprim)
-            {
-                cprim = mxprim;
-                DrawList dl;
-                dl.m_layerId = layer;
-                dl.m_primType = (DrawPrimitiveType)cprim;
-                dl.m_vertexData = m_vertexData[1][layer * DrawPrimitive_Count + cprim]->data() + (search[cprim] - sortData[cprim].data()) * VertsPerDrawPrimitive[cprim];
-                dl.m_vertexCount = 0;
-                m_drawLists.push_back(dl);
-                first = false;
-            }
-
-            // increment the vertex count for the current draw list
-            m_drawLists.back().m_vertexCount += VertsPerDrawPrimitive[cprim];
-            ++search[cprim];
-            if (search[cprim] == sortData[cprim].end())
-            {
-                search[cprim] = 0;
-                ++emptyCount;
-            }
+            return table[slot].m_detail;
         }
-#undef modinc
     }
-
-    m_sortCalled = true;
 }
 
-int Context::findLayerIndex(Id _id) const
+void Context::insertLodDetail(U32 _key, int _detail)
 {
-    for (int i = 0; i < (int)m_layerIdMap.size(); ++i)
+    // keep the load factor <= 1/2, rehash all entries when growing
+    Vector<LodEntry> &table = m_lodHash[m_lodHashIndex];
+    if ((m_lodCount + 1) * 2 > table.size())
     {
-        if (m_layerIdMap[i] == _id)
+        Vector<LodEntry> entries;
+        entries.setAllocator(&m_allocator);
+        Vector<LodEntry>::swap(entries, table);
+        const LodEntry empty = { 0, 0 };
+        table.resize(entries.empty() ? 64 : entries.size() * 2, empty);
+        m_lodCount = 0;
+        for (const LodEntry &entry : entries)
         {
-            return i;
+            if (entry.m_key != 0)
+            {
+                insertLodDetail(entry.m_key, entry.m_detail);
+            }
         }
     }
-    return -1;
+    const U32 mask = table.size() - 1;
+    U32 slot = _key & mask;
+    while (table[slot].m_key != 0 && table[slot].m_key != _key)
+    {
+        slot = (slot + 1) & mask;
+    }
+    m_lodCount += table[slot].m_key == 0 ? 1 : 0;
+    table[slot].m_key = _key;
+    table[slot].m_detail = _detail;
 }
 
 bool Context::isVisible(const VertexData *_vdata, DrawPrimitiveType _prim)
@@ -1953,6 +4557,10 @@ bool Context::isVisible(const VertexData *_vdata, DrawPrimitiveType _prim)
 
 bool Context::isVisible(const Vec3 &_origin, float _radius)
 {
+    if (m_recordingIndex != -1)
+    {
+        return true;
+    }
     for (int i = 0; i < m_cullFrustumCount; ++i)
     {
         const Vec4 &plane = m_cullFrustum[i];
@@ -1966,6 +4574,10 @@ bool Context::isVisible(const Vec3 &_origin, float _radius)
 
 bool Context::isVisible(const Vec3 &_min, const Vec3 &_max)
 {
+    if (m_recordingIndex != -1)
+    {
+        return true;
+    }
 #if 0
  	const Vec3 points[] = {
 		Vec3(_min.x, _min.y, _min.z),
@@ -2011,9 +4623,315 @@ bool Context::isVisible(const Vec3 &_min, const Vec3 &_max)
 #endif
 }
 
+void Context::occluders(const Vec3 *_positions, U32 _positionStride, const U32 *_indices, U32 _indexCount)
+{
+    IM3D_ASSERT(m_primMode == PrimitiveMode_None); // can't submit occluders mid-primitive
+    IM3D_ASSERT(_indexCount % 3 == 0);
+    if (!m_occlusionEnabled)
+    {
+        const U32 tile = kOcclusionTileSize;
+        const Vec2 viewport = m_appData.m_viewportSize;
+        const float width = (float)(m_appData.m_occlusionBufferWidth > 0 ? m_appData.m_occlusionBufferWidth : kOcclusionDefaultWidth);
+        const float height = viewport.x > 0.0f && viewport.y > 0.0f ? width * viewport.y / viewport.x : width;
+        // the buffer is stretched to a whole number of tiles, occluders and occludees are projected the same way
+        m_occlusionWidth = (U32)Max((int)((width + (float)(tile - 1)) / (float)tile), 1) * tile;
+        m_occlusionHeight = (U32)Max((int)((height + (float)(tile - 1)) / (float)tile), 1) * tile;
+        m_occlusionDepth.resize(m_occlusionWidth * m_occlusionHeight, FLT_MAX);
+        m_occlusionTestDepth.resize(m_occlusionWidth * m_occlusionHeight, FLT_MAX);
+        m_occlusionTileDepth.resize((m_occlusionWidth / tile) * (m_occlusionHeight / tile), FLT_MAX);
+        for (U32 i = 0; i < m_occlusionDepth.size(); ++i)
+        {
+            m_occlusionDepth[i] = FLT_MAX;
+        }
+        m_occlusionEnabled = true;
+    }
+    m_occlusionTestDirty = true;
+    m_occlusionVisibleMin = Vec3(FLT_MAX);
+    m_occlusionVisibleMax = Vec3(-FLT_MAX);
+
+    const Mat4 viewProj = m_matrixStack.size() > 1 ? m_appData.m_occlusionViewProj * m_matrixStack.back() : m_appData.m_occlusionViewProj;
+    // occluders in front of the near plane are clipped by the GPU and mustn't hide anything, clip them against it where available
+    Vec4 nearPlane = m_appData.m_cullFrustum[FrustumPlane_Near];
+    const bool clipNear = !std::isinf(nearPlane.w);
+    if (clipNear && m_matrixStack.size() > 1)
+    { // transform the plane to the occluder's space
+        const Mat4 &m = m_matrixStack.back();
+        nearPlane = Vec4(
+            nearPlane.x * m(0, 0) + nearPlane.y * m(1, 0) + nearPlane.z * m(2, 0),
+            nearPlane.x * m(0, 1) + nearPlane.y * m(1, 1) + nearPlane.z * m(2, 1),
+            nearPlane.x * m(0, 2) + nearPlane.y * m(1, 2) + nearPlane.z * m(2, 2),
+            nearPlane.w - (nearPlane.x * m(0, 3) + nearPlane.y * m(1, 3) + nearPlane.z * m(2, 3)));
+    }
+
+    const float sx = 0.5f * (float)m_occlusionWidth;
+    const float sy = 0.5f * (float)m_occlusionHeight;
+    const char *positions = (const char *)_positions;
+    for (U32 i = 0; i < _indexCount; i += 3)
+    {
+        // clip space vertices and distances to the near plane
+        Vec4 in[3];
+        float dist[3];
+        for (int j = 0; j < 3; ++j)
+        {
+            const Vec3 &p = *(const Vec3 *)(positions + _indices[i + j] * _positionStride);
+            in[j] = viewProj * Vec4(p, 1.0f);
+            dist[j] = clipNear ? Distance(nearPlane, p) : in[j].w - kOcclusionMinW;
+        }
+
+        // clip the triangle against the near plane, the result has up to 4 vertices
+        Vec4 out[4];
+        int outCount = 0;
+        for (int j = 0; j < 3; ++j)
+        {
+            const int k = (j + 1) % 3;
+            if (dist[j] >= 0.0f)
+            {
+                out[outCount++] = in[j];
+            }
+            if ((dist[j] >= 0.0f) != (dist[k] >= 0.0f))
+            {
+                const float t = dist[j] / (dist[j] - dist[k]);
+                out[outCount++] = in[j] + (in[k] - in[j]) * t;
+            }
+        }
+        if (outCount < 3)
+        {
+            continue;
+        }
+
+        Vec3 screen[4];
+        bool valid = true;
+        for (int j = 0; j < outCount; ++j)
+        {
+            valid &= out[j].w >= kOcclusionMinW;
+            const float rw = 1.0f / out[j].w;
+            screen[j] = Vec3((out[j].x * rw + 1.0f) * sx, (1.0f - out[j].y * rw) * sy, out[j].z * rw);
+        }
+        if (!valid)
+        { // skipping an occluder is always safe
+            continue;
+        }
+        for (int j = 2; j < outCount; ++j)
+        {
+            RasterizeOccluder(screen[0], screen[j - 1], screen[j], m_occlusionDepth.data(), m_occlusionWidth, m_occlusionHeight);
+        }
+    }
+}
+
+bool Context::isOccluded(const Vec3 &_origin, float _radius)
+{
+    if (!m_occlusionEnabled)
+    {
+        return false;
+    }
+    Vec3 origin = _origin;
+    if (m_matrixStack.size() > 1)
+    {
+        const Mat4 &m = m_matrixStack.back();
+        Vec3 scale = m.getScale();
+        origin = m * _origin;
+        _radius *= Max(Max(scale.x, scale.y), scale.z);
+    }
+    return isOccluded(origin - Vec3(_radius), origin + Vec3(_radius));
+}
+
+bool Context::isOccluded(const Vec3 &_min, const Vec3 &_max)
+{
+    if (!m_occlusionEnabled || m_recordingIndex != -1)
+    {
+        return false;
+    }
+    if (_min.x >= m_occlusionVisibleMin.x && _min.y >= m_occlusionVisibleMin.y && _min.z >= m_occlusionVisibleMin.z &&
+        _max.x <= m_occlusionVisibleMax.x && _max.y <= m_occlusionVisibleMax.y && _max.z <= m_occlusionVisibleMax.z)
+    { // inside the last visible box, may still be occluded but keeping it is conservative
+        return false;
+    }
+    const U32 tile = kOcclusionTileSize;
+    const U32 tileCountX = m_occlusionWidth / tile;
+    if (m_occlusionTestDirty)
+    {
+        updateOcclusionTest();
+    }
+
+    // project the corners to NDC, the nearest depth of the box is at one of them
+    const Mat4 &viewProj = m_appData.m_occlusionViewProj;
+    float ndcMin[2], ndcMax[2], nearest;
+#if IM3D_SIMD
+    { // lane i = corner i, lo/hi = min/max z
+        const __m128 xs = _mm_setr_ps(_min.x, _max.x, _min.x, _max.x);
+        const __m128 ys = _mm_setr_ps(_min.y, _min.y, _max.y, _max.y);
+        const __m128 zlo = _mm_set1_ps(_min.z);
+        const __m128 zhi = _mm_set1_ps(_max.z);
+        __m128 lo[4], hi[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            const __m128 xy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj(i, 0)), xs), _mm_mul_ps(_mm_set1_ps(viewProj(i, 1)), ys)), _mm_set1_ps(viewProj(i, 3)));
+            lo[i] = _mm_add_ps(xy, _mm_mul_ps(_mm_set1_ps(viewProj(i, 2)), zlo));
+            hi[i] = _mm_add_ps(xy, _mm_mul_ps(_mm_set1_ps(viewProj(i, 2)), zhi));
+        }
+        if (_mm_movemask_ps(_mm_cmplt_ps(_mm_min_ps(lo[3], hi[3]), _mm_set1_ps(kOcclusionMinW))) != 0)
+        { // crosses the view plane
+            return false;
+        }
+        const __m128 rwlo = _mm_div_ps(_mm_set1_ps(1.0f), lo[3]);
+        const __m128 rwhi = _mm_div_ps(_mm_set1_ps(1.0f), hi[3]);
+        float tmp[4][4];
+        for (int i = 0; i < 3; ++i)
+        {
+            const __m128 a = _mm_mul_ps(lo[i], rwlo);
+            const __m128 b = _mm_mul_ps(hi[i], rwhi);
+            __m128 mn = _mm_min_ps(a, b);
+            __m128 mx = _mm_max_ps(a, b);
+            mn = _mm_min_ps(mn, _mm_shuffle_ps(mn, mn, _MM_SHUFFLE(1, 0, 3, 2)));
+            mx = _mm_max_ps(mx, _mm_shuffle_ps(mx, mx, _MM_SHUFFLE(1, 0, 3, 2)));
+            _mm_storeu_ps(tmp[0], _mm_min_ps(mn, _mm_shuffle_ps(mn, mn, _MM_SHUFFLE(2, 3, 0, 1))));
+            _mm_storeu_ps(tmp[1], _mm_max_ps(mx, _mm_shuffle_ps(mx, mx, _MM_SHUFFLE(2, 3, 0, 1))));
+            if (i < 2)
+            {
+                ndcMin[i] = tmp[0][0];
+                ndcMax[i] = tmp[1][0];
+            }
+            else
+            {
+                nearest = tmp[0][0];
+            }
+        }
+    }
+#else
+    const Vec4 cx[2] = {viewProj.getCol(0) * _min.x, viewProj.getCol(0) * _max.x};
+    const Vec4 cy[2] = {viewProj.getCol(1) * _min.y, viewProj.getCol(1) * _max.y};
+    const Vec4 cz[2] = {viewProj.getCol(2) * _min.z + viewProj.getCol(3), viewProj.getCol(2) * _max.z + viewProj.getCol(3)};
+    ndcMin[0] = ndcMin[1] = nearest = FLT_MAX;
+    ndcMax[0] = ndcMax[1] = -FLT_MAX;
+    for (int i = 0; i < 8; ++i)
+    {
+        const Vec4 p = cx[i & 1] + cy[(i >> 1) & 1] + cz[i >> 2];
+        if (p.w < kOcclusionMinW)
+        { // crosses the view plane
+            return false;
+        }
+        const float rw = 1.0f / p.w;
+        ndcMin[0] = Min(ndcMin[0], p.x * rw);
+        ndcMax[0] = Max(ndcMax[0], p.x * rw);
+        ndcMin[1] = Min(ndcMin[1], p.y * rw);
+        ndcMax[1] = Max(ndcMax[1], p.y * rw);
+        nearest = Min(nearest, p.z * rw);
+    }
+#endif
+    // NDC -> pixels, as per occluders()
+    float minX = (ndcMin[0] + 1.0f) * 0.5f * (float)m_occlusionWidth;
+    float maxX = (ndcMax[0] + 1.0f) * 0.5f * (float)m_occlusionWidth;
+    float minY = (1.0f - ndcMax[1]) * 0.5f * (float)m_occlusionHeight;
+    float maxY = (1.0f - ndcMin[1]) * 0.5f * (float)m_occlusionHeight;
+    minX = Max(minX, 0.0f);
+    maxX = Min(maxX, (float)m_occlusionWidth);
+    minY = Max(minY, 0.0f);
+    maxY = Min(maxY, (float)m_occlusionHeight);
+    if (minX >= maxX || minY >= maxY)
+    { // off screen, leave it to frustum culling
+        return false;
+    }
+    // all pixels touched by the box
+    U32 x0, x1, y0, y1;
+    PixelRange(minX, maxX, x0, x1);
+    PixelRange(minY, maxY, y0, y1);
+
+    for (U32 ty = y0 / tile; ty <= (y1 - 1) / tile; ++ty)
+    {
+        for (U32 tx = x0 / tile; tx <= (x1 - 1) / tile; ++tx)
+        {
+            if (m_occlusionTileDepth[ty * tileCountX + tx] < nearest)
+            { // the whole tile is in front of the box
+                continue;
+            }
+            const U32 px0 = x0 > tx * tile ? x0 : tx * tile;
+            const U32 px1 = x1 < (tx + 1) * tile ? x1 : (tx + 1) * tile;
+            const U32 py0 = y0 > ty * tile ? y0 : ty * tile;
+            const U32 py1 = y1 < (ty + 1) * tile ? y1 : (ty + 1) * tile;
+            for (U32 y = py0; y < py1; ++y)
+            {
+                const float *row = m_occlusionTestDepth.data() + y * m_occlusionWidth;
+                for (U32 x = px0; x < px1; ++x)
+                {
+                    if (row[x] >= nearest)
+                    {
+                        m_occlusionVisibleMin = _min;
+                        m_occlusionVisibleMax = _max;
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void Context::updateOcclusionTest()
+{
+    // pixels on the occluders' silhouette may be only partially covered, or the depth at the center may not be the farthest over the
+    // pixel where the occluder's surface is curved; only trust pixels whose 3x3 neighborhood is covered, with the farthest depth of it
+    const U32 width = m_occlusionWidth;
+    const U32 height = m_occlusionHeight;
+    const float *src = m_occlusionDepth.data();
+    float *dst = m_occlusionTestDepth.data();
+    for (U32 y = 0; y < height; ++y)
+    {
+        float *row = dst + y * width;
+        if (y == 0 || y == height - 1)
+        {
+            for (U32 x = 0; x < width; ++x)
+            {
+                row[x] = FLT_MAX;
+            }
+            continue;
+        }
+        // vertical max, then horizontal max in place
+        const float *above = src + (y - 1) * width;
+        const float *center = src + y * width;
+        const float *below = src + (y + 1) * width;
+        for (U32 x = 0; x < width; ++x)
+        {
+            row[x] = Max(above[x], Max(center[x], below[x]));
+        }
+        float prev = FLT_MAX;
+        for (U32 x = 0; x < width - 1; ++x)
+        {
+            const float cur = row[x];
+            row[x] = Max(prev, Max(cur, row[x + 1]));
+            prev = cur;
+        }
+        row[width - 1] = FLT_MAX;
+    }
+
+    const U32 tile = kOcclusionTileSize;
+    const U32 tileCountX = width / tile;
+    for (U32 ty = 0; ty < height / tile; ++ty)
+    {
+        for (U32 tx = 0; tx < tileCountX; ++tx)
+        {
+            float farthest = -FLT_MAX;
+            for (U32 y = ty * tile; y < (ty + 1) * tile; ++y)
+            {
+                const float *row = dst + y * width + tx * tile;
+                for (U32 x = 0; x < tile; ++x)
+                {
+                    farthest = Max(farthest, row[x]);
+                }
+            }
+            m_occlusionTileDepth[ty * tileCountX + tx] = farthest;
+        }
+    }
+    m_occlusionTestDirty = false;
+}
+
 Context::VertexList *Context::getCurrentVertexList()
 {
-    return m_vertexData[m_vertexDataIndex][m_layerIndex * DrawPrimitive_Count + m_primType];
+    return &m_vertexData[m_vertexDataIndex][m_layerIndex * DrawPrimitive_Count + m_primType];
+}
+
+Context::IndexList *Context::getCurrentIndexList()
+{
+    return &m_indexData[m_vertexDataIndex][m_layerIndex * DrawPrimitive_Count + m_primType];
 }
 
 float Context::pixelsToWorldSize(const Vec3 &_position, float _pixels)
@@ -2028,8 +4946,63 @@ float Context::worldSizeToPixels(const Vec3 &_position, float _size)
     return (_size * m_appData.m_viewportSize.y) / d / m_appData.m_projScaleY;
 }
 
+bool Context::isBelowMinPixelSize(const Vec3 &_position, float _radius)
+{
+    if (m_appData.m_cullMinPixelSize <= 0.0f || m_recordingIndex != -1)
+    {
+        return false;
+    }
+    Vec3 position = _position;
+    if (m_matrixStack.size() > 1)
+    {
+        const Mat4 &m = m_matrixStack.back();
+        Vec3 scale = m.getScale();
+        position = m * _position;
+        _radius *= Max(Max(scale.x, scale.y), scale.z);
+    }
+    return worldSizeToPixels(position, _radius * 2.0f) < m_appData.m_cullMinPixelSize;
+}
+
 int Context::estimateLevelOfDetail(const Vec3 &_position, float _worldSize, int _min, int _max)
 {
+    if (m_appData.m_lodPixelError > 0.0f)
+    {
+        Vec3 position = _position;
+        float radius = _worldSize;
+        if (m_matrixStack.size() > 1)
+        {
+            const Mat4 &m = m_matrixStack.back();
+            Vec3 scale = m.getScale();
+            position = m * _position;
+            radius *= Max(Max(scale.x, scale.y), scale.z);
+        }
+
+        // a chord across n segments deviates from the circle by r * (1 - cos(Pi / n)), choose n such that this is <= the error
+        float r = worldSizeToPixels(position, radius);
+        float e = m_appData.m_lodPixelError * m_lodErrorScale;
+        int detail = kLodMaxDetail;
+        if (e >= r)
+        {
+            detail = kLodMinDetail;
+        }
+        else
+        {
+            float n = Pi / acosf(1.0f - e / r);
+            detail = n < (float)kLodMaxDetail ? Max((int)ceilf(n), kLodMinDetail) : kLodMaxDetail;
+        }
+
+        // keep the previous frame's detail unless the ideal detail is outside the hysteresis band, avoids flickering when the
+        // shape is close to a transition
+        U32 key = LodKey(m_idStack.back(), _position, _worldSize);
+        int prev = findLodDetail(m_lodHashIndex ^ 1, key);
+        if (prev > 0 && (float)detail * (1.0f + kLodHysteresis) >= (float)prev && (float)detail <= (float)prev * (1.0f + kLodHysteresis))
+        {
+            detail = prev;
+        }
+        insertLodDetail(key, detail);
+        return detail;
+    }
+
     if (m_appData.m_projOrtho)
     {
         return _max;
@@ -2040,6 +5013,25 @@ int Context::estimateLevelOfDetail(const Vec3 &_position, float _worldSize, int
     float fmax = (float)_max;
     return (int)(fmin + (fmax - fmin) * x);
 }
+const Vec2 *Context::getUnitCircle(int _detail)
+{
+    IM3D_ASSERT(_detail > 0);
+    while ((int)m_unitCircles.size() <= _detail)
+    {
+        AddList(m_unitCircles, &m_allocator);
+    }
+    Vector<Vec2> &circle = m_unitCircles[_detail];
+    if (circle.empty())
+    {
+        circle.reserve(_detail + 1);
+        for (int i = 0; i <= _detail; ++i)
+        {
+            float rad = TwoPi * ((float)i / (float)_detail);
+            circle.push_back(Vec2(cosf(rad), sinf(rad)));
+        }
+    }
+    return circle.data();
+}
 
 bool Context::gizmoAxisTranslation_Behavior(Id _id, const Vec3 &_origin, const Vec3 &_axis, float _snap, float _worldHeight, float _worldSize, Vec3 *_out_)
 {
@@ -2384,20 +5376,21 @@ void Context::gizmoAxislAngle_Draw(Id _id, const Vec3 &_origin, const Vec3 &_axi
     }
     pushColor(color);
     pushSize(m_gizmoSizePixels);
+    const int detail = estimateLevelOfDetail(_origin, _worldRadius, 16, 128);
     pushMatrix(getMatrix() * LookAt(_origin, _origin + _axis, m_appData.m_worldUp));
     begin(PrimitiveMode_LineLoop);
-    const int detail = estimateLevelOfDetail(_origin, _worldRadius, 16, 128);
+    const Vec2 *circle = getUnitCircle(detail);
     for (int i = 0; i < detail; ++i)
     {
-        float rad = TwoPi * ((float)i / (float)detail);
-        vertex(Vec3(cosf(rad) * _worldRadius, sinf(rad) * _worldRadius, 0.0f));
+        Vec3 p = Vec3(circle[i].x * _worldRadius, circle[i].y * _worldRadius, 0.0f);
 
-        // post-modify the alpha for parts of the ring occluded by the sphere
-        VertexData &vd = getCurrentVertexList()->back();
-        Vec3 v = vd.m_positionSize;
+        // fade out parts of the ring occluded by the sphere
+        Vec3 v = getMatrix() * p;
         float d = Dot(Normalize(_origin - v), m_appData.m_viewDirection);
         d = Max(Remap(d, 0.1f, 0.2f), aligned);
-        vd.m_color.setA(vd.m_color.getA() * d);
+        Color c = color;
+        c.setA(c.getA() * d);
+        vertex(p, m_gizmoSizePixels, c);
     }
     end();
     popMatrix();
@@ -2541,7 +5534,11 @@ U32 Context::getPrimitiveCount(DrawPrimitiveType _type) const
     for (U32 i = 0; i < m_layerIdMap.size(); ++i)
     {
         U32 j = i * DrawPrimitive_Count + _type;
-        ret += m_vertexData[0][j]->size() + m_vertexData[1][j]->size();
+#if IM3D_INDEXED_PRIMITIVES
+        ret += m_indexData[0][j].size() + m_indexData[1][j].size();
+#else
+        ret += m_vertexData[0][j].size() + m_vertexData[1][j].size();
+#endif
     }
     ret /= VertsPerDrawPrimitive[_type];
     return ret;
@@ -3114,6 +6111,8 @@ IM3D_EXPORT inline void Vertex(float _x, float _y, float _z) { Vertex(Vec3(_x, _
 IM3D_EXPORT inline void Vertex(float _x, float _y, float _z, Color _color) { Vertex(Vec3(_x, _y, _z), _color); }
 IM3D_EXPORT inline void Vertex(float _x, float _y, float _z, float _size) { Vertex(Vec3(_x, _y, _z), _size); }
 IM3D_EXPORT inline void Vertex(float _x, float _y, float _z, float _size, Color _color) { Vertex(Vec3(_x, _y, _z), _size, _color); }
+IM3D_EXPORT inline void Vertices(const Vec3 *_positions, const Color *_colors, const float *_sizes, U32 _count) { GetContext().vertices(_positions, _colors, _sizes, _count); }
+IM3D_EXPORT inline void Vertices(const VertexData *_vertices, U32 _count) { GetContext().vertices(_vertices, _count); }
 
 IM3D_EXPORT inline void PushDrawState()
 {
@@ -3178,6 +6177,13 @@ IM3D_EXPORT inline void PushLayerId(const char *_str) { PushLayerId(MakeId(_str)
 IM3D_EXPORT inline void PopLayerId() { GetContext().popLayerId(); }
 IM3D_EXPORT inline Id GetLayerId() { return GetContext().getLayerId(); }
 
+IM3D_EXPORT inline bool PushCullBounds(const Vec3 &_min, const Vec3 &_max) { return GetContext().pushCullBounds(_min, _max); }
+IM3D_EXPORT inline void PopCullBounds() { GetContext().popCullBounds(); }
+IM3D_EXPORT inline void BeginRecording(Id _id) { GetContext().beginRecording(_id); }
+IM3D_EXPORT inline void EndRecording() { GetContext().endRecording(); }
+IM3D_EXPORT inline void DrawRecorded(Id _id) { GetContext().drawRecorded(_id, nullptr); }
+IM3D_EXPORT inline void DrawRecorded(Id _id, const Mat4 &_transform) { GetContext().drawRecorded(_id, &_transform); }
+
 IM3D_EXPORT inline bool GizmoTranslation(const char *_id, float _translation_[3], bool _local) { return GizmoTranslation(MakeId(_id), _translation_, _local); }
 IM3D_EXPORT inline bool GizmoRotation(const char *_id, float _rotation_[3 * 3], bool _local) { return GizmoRotation(MakeId(_id), _rotation_, _local); }
 IM3D_EXPORT inline bool GizmoRotation4x4(const char *_id, float _rotation_[4 * 4], bool _local)
@@ -3198,10 +6204,13 @@ IM3D_EXPORT inline bool Gizmo(const char *_id, float _transform_[4 * 4]) { retur
 
 IM3D_EXPORT inline bool IsVisible(const Vec3 &_origin, float _radius) { return GetContext().isVisible(_origin, _radius); }
 IM3D_EXPORT inline bool IsVisible(const Vec3 &_min, const Vec3 &_max) { return GetContext().isVisible(_min, _max); }
+IM3D_EXPORT inline void DrawPolyline(const Vec3 *_points, const Color *_colors, U32 _count, float _pixelError) { GetContext().drawPolyline(_points, _colors, _count, _pixelError); }
+IM3D_EXPORT inline void Occluders(const Vec3 *_positions, U32 _positionStride, const U32 *_indices, U32 _indexCount) { GetContext().occluders(_positions, _positionStride, _indices, _indexCount); }
+IM3D_EXPORT inline bool IsOccluded(const Vec3 &_min, const Vec3 &_max) { return GetContext().isOccluded(_min, _max); }
 
 IM3D_EXPORT inline Context &GetContext() { return *internal::g_CurrentContext; }
 IM3D_EXPORT inline void SetContext(Context &_ctx) { internal::g_CurrentContext = &_ctx; }
-IM3D_EXPORT Context *NewContext() { return new Context; }
+IM3D_EXPORT Context *NewContext(const Allocator *_allocator) { return new Context(_allocator); }
 IM3D_EXPORT void DestoryContext(Context *c)
 {
     if (c)
@@ -4,6 +4,8 @@
 
 #include "im3d_config.h"
 
+#include <cstddef>
+
 #define IM3D_VERSION "1.14"
 
 #ifndef IM3D_ASSERT
@@ -15,10 +17,17 @@
 #define IM3D_VERTEX_ALIGNMENT 4
 #endif
 
+#ifndef IM3D_VERTEX_COMPACT
+#define IM3D_VERTEX_COMPACT 0
+#endif
+
 namespace Im3d
 {
 
+typedef unsigned short U16;
 typedef unsigned int U32;
+typedef unsigned long long U64;
+struct Allocator;
 struct Vec2;
 struct Vec3;
 struct Vec4;
@@ -26,6 +35,11 @@ struct Mat3;
 struct Mat4;
 struct Color;
 struct VertexData;
+#if IM3D_VERTEX_COMPACT
+struct DrawVertex;
+#else
+typedef VertexData DrawVertex;
+#endif
 struct AppData;
 struct DrawList;
 class Context;
@@ -68,6 +82,12 @@ IM3D_EXPORT void Vertex(float _x, float _y, float _z, Color _color);
 IM3D_EXPORT void Vertex(float _x, float _y, float _z, float _size);
 IM3D_EXPORT void Vertex(float _x, float _y, float _z, float _size, Color _color);
 
+// Add _count vertices to the current primitive in a single call (call between Begin*() and End()). This is equivalent to calling
+// Vertex() for each element but avoids the per-vertex call overhead. _colors and/or _sizes may be null, in which case the current
+// color/size draw state is used. The matrix and alpha draw states are applied as for Vertex().
+IM3D_EXPORT void Vertices(const Vec3 *_positions, const Color *_colors, const float *_sizes, U32 _count);
+IM3D_EXPORT void Vertices(const VertexData *_vertices, U32 _count);
+
 // Color draw state (per vertex).
 IM3D_EXPORT void PushColor(); // push the stack top
 IM3D_EXPORT void PushColor(Color _color);
@@ -114,6 +134,8 @@ IM3D_EXPORT void Rotate(const Mat3 &_rotation);
 IM3D_EXPORT void Scale(float _x, float _y, float _z);
 
 // High order shapes. Where _detail = -1, an automatic level of detail is chosen based on the distance to the view origin (as specified via the AppData struct).
+// With AppData::m_lodPixelError the detail of each shape is kept until it changes significantly; shapes are identified by the current id,
+// their position and their size.
 IM3D_EXPORT void DrawXyzAxes();
 IM3D_EXPORT void DrawPoint(const Vec3 &_position, float _size, Color _color);
 IM3D_EXPORT void DrawLine(const Vec3 &_a, const Vec3 &_b, float _size, Color _color);
@@ -131,6 +153,16 @@ IM3D_EXPORT void DrawCylinder(const Vec3 &_start, const Vec3 &_end, float _radiu
 IM3D_EXPORT void DrawCapsule(const Vec3 &_start, const Vec3 &_end, float _radius, int _detail = -1);
 IM3D_EXPORT void DrawPrism(const Vec3 &_start, const Vec3 &_end, float _radius, int _sides);
 IM3D_EXPORT void DrawArrow(const Vec3 &_start, const Vec3 &_end, float _headLength = -1.0f, float _headThickness = -1.0f);
+// Batched versions of DrawSphere(), DrawAlignedBox(), DrawArrow(); _count shapes are culled per element and written as a single line list.
+// Output matches calling the single versions per element, except that AppData::m_cullMinPixelSize is tested per shape rather than per
+// primitive of the shape. _colors may be nullptr (use the current color).
+IM3D_EXPORT void DrawSpheres(const Vec3 *_origins, const float *_radii, const Color *_colors, U32 _count, int _detail = -1);
+IM3D_EXPORT void DrawAlignedBoxes(const Vec3 *_mins, const Vec3 *_maxs, const Color *_colors, U32 _count);
+IM3D_EXPORT void DrawArrows(const Vec3 *_starts, const Vec3 *_ends, const Color *_colors, U32 _count, float _headLength = -1.0f, float _headThickness = -1.0f);
+// Line strip through _count points, simplified so that it deviates from the input by about _pixelError pixels on screen and split
+// into runs where it leaves the cull frustum, i.e. the vertex count follows the on-screen detail rather than _count. _colors may be
+// nullptr (use the current color). _pixelError < 0 uses AppData::m_lodPixelError (0.5 if not set), 0 = no simplification.
+IM3D_EXPORT void DrawPolyline(const Vec3 *_points, const Color *_colors, U32 _count, float _pixelError = -1.0f);
 
 // Ids are used to uniquely identify gizmos and layers. Gizmo should have a unique id during a frame.
 // Note that ids are a hash of the whole id stack, see PushId(), PopId().
@@ -177,10 +209,32 @@ IM3D_EXPORT bool Gizmo(Id _id, float _translation_[3], float _rotation_[3 * 3],
 IM3D_EXPORT bool IsVisible(const Vec3 &_origin, float _radius); // sphere
 IM3D_EXPORT bool IsVisible(const Vec3 &_min, const Vec3 &_max); // axis-aligned bounding box
 
+// Cull scopes. PushCullBounds() tests _min/_max (transformed by the current matrix) against the cull frustum once; if not visible,
+// Begin*()/Vertex()/Draw*() are no-ops until the matching PopCullBounds(). Scopes nested inside a culled scope are also culled.
+// Return false if the scope is culled, use this to skip generating the primitives entirely.
+IM3D_EXPORT bool PushCullBounds(const Vec3 &_min, const Vec3 &_max);
+IM3D_EXPORT void PopCullBounds();
+
+// Occlusion culling. Occluders() rasterizes triangles (transformed by the current matrix) into a low resolution depth buffer using
+// AppData::m_occlusionViewProj; subsequent primitives and Draw*() shapes which are completely hidden behind the occluders are discarded.
+// Occluders are cleared by NewFrame(), submit them before any primitives they should hide. _positionStride is in bytes.
+IM3D_EXPORT void Occluders(const Vec3 *_positions, U32 _positionStride, const U32 *_indices, U32 _indexCount);
+IM3D_EXPORT bool IsOccluded(const Vec3 &_min, const Vec3 &_max); // world space axis-aligned bounding box
+
+// Retained geometry. Primitives and Draw*() shapes between BeginRecording() and EndRecording() are stored in the context instead of
+// being drawn (transformed by the current matrix, alpha starts at 1). Culling is skipped while recording; pass an explicit _detail to
+// Draw*() to avoid recording a view-dependent LOD. DrawRecorded() adds the stored primitives to the current layer as per Begin*()/End(),
+// transformed by _transform and the current matrix, with the current sorting/cull scope state; alpha is multiplied by the current alpha.
+// Recordings persist between frames, recording an existing _id replaces it.
+IM3D_EXPORT void BeginRecording(Id _id);
+IM3D_EXPORT void EndRecording();
+IM3D_EXPORT void DrawRecorded(Id _id);
+IM3D_EXPORT void DrawRecorded(Id _id, const Mat4 &_transform);
+
 // Get/set the current context. All Im3d calls affect the currently bound context.
 IM3D_EXPORT Context &GetContext();
 IM3D_EXPORT void SetContext(Context &_ctx);
-IM3D_EXPORT Context *NewContext();
+IM3D_EXPORT Context *NewContext(const Allocator *_allocator = nullptr);
 IM3D_EXPORT void DestoryContext(Context *c);
 
 // Merge vertex data from _src into _dst_. Layers are preserved. Call before EndFrame().
@@ -397,6 +451,23 @@ struct alignas(IM3D_VERTEX_ALIGNMENT) VertexData
     VertexData(const Vec3 &_position, float _size, Color _color) : m_positionSize(_position, _size), m_color(_color) {}
 };
 
+#if IM3D_VERTEX_COMPACT
+// Compact vertex format for draw lists (IM3D_VERTEX_COMPACT), VertexData is still used for submission.
+struct DrawVertex
+{
+    U16 m_position[3]; // xyz half float, relative to DrawList::m_origin
+    U16 m_size;        // half float
+    Color m_color;     // rgba8 (MSB = r)
+    U32 m_pad;         // pad to 16 bytes (GL3 shaders read a uvec4 per vertex)
+
+    DrawVertex() {}
+    DrawVertex(const Vec3 &_position, float _size, Color _color); // _position relative to the draw list origin
+
+    Vec3 getPosition() const; // relative to DrawList::m_origin
+    float getSize() const;
+};
+#endif
+
 enum DrawPrimitiveType
 {
     // order here determines the order in which unsorted primitives are drawn
@@ -411,11 +482,21 @@ struct DrawList
 {
     Id m_layerId;
     DrawPrimitiveType m_primType;
-    const VertexData *m_vertexData;
+    const DrawVertex *m_vertexData;
     U32 m_vertexCount;
+#if IM3D_VERTEX_COMPACT
+    Vec3 m_origin; // Add to DrawVertex positions to get the world space position (view origin at NewFrame()).
+#endif
+    const U32 *m_indexData; // Indices into m_vertexData if IM3D_INDEXED_PRIMITIVES, else null (draw m_vertexData directly).
+    U32 m_indexCount;
 };
 typedef void(DrawPrimitivesCallback)(const DrawList &_drawList);
 
+// Call _task(i, _taskData) for each i in [0, _count), e.g. on a thread pool, and return when all calls have completed. Calls may
+// run concurrently and in any order.
+typedef void(ParallelTaskCallback)(U32 _index, void *_taskData);
+typedef void(ParallelForCallback)(U32 _count, ParallelTaskCallback *_task, void *_taskData);
+
 enum Key
 {
     Mouse_Left,
@@ -464,15 +545,33 @@ struct AppData
     float m_snapTranslation;                // Snap value for translation gizmos (world units). 0 = disabled.
     float m_snapRotation;                   // Snap value for rotation gizmos (radians). 0 = disabled.
     float m_snapScale;                      // Snap value for scale gizmos. 0 = disabled.
+    float m_cullMinPixelSize;               // Primitives which project to fewer pixels than this are discarded (Draw*() helpers draw a single point instead). 0 = disabled.
+    Mat4 m_occlusionViewProj;               // View-projection matrix for occlusion culling, see Occluders(). Depth (z/w) must increase with distance (no reversed z).
+    U32 m_occlusionBufferWidth;             // Occlusion buffer width (pixels), the height follows the viewport aspect ratio. 0 = 256.
+    float m_lodPixelError;                  // Max screen space error (pixels) for automatic Draw*() level of detail, e.g. 0.5. 0 = distance based (legacy).
+    U32 m_lodVertexBudget;                  // Vertices per frame above which m_lodPixelError is scaled up, adapted over several frames. 0 = no budget.
+    U32 m_sortBucketCount;                  // Approximate sorting into this many logarithmic depth buckets between the near/far cull planes (primitives within a bucket keep their submission order). 0 = exact.
+    float m_sortMergeTolerance;             // Relative distance within which sorted primitives of different types may be drawn out of order to produce fewer draw lists (e.g. 0.05 = 5%). 0 = exact.
     void *m_appData;                        // App-specific data.
 
     DrawPrimitivesCallback *drawCallback; // e.g. void Im3d_Draw(const DrawList& _drawList)
+    ParallelForCallback *parallelForCallback; // Optional, EndFrame() sorts layers concurrently via this. Null = sort serially.
 
     // Extract cull frustum planes from the view-projection matrix.
     // Set _ndcZNegativeOneToOne = true if the proj matrix maps z from [-1,1] (OpenGL style).
     void setCullFrustum(const Mat4 &_viewProj, bool _ndcZNegativeOneToOne);
 };
 
+// Memory allocation callbacks. Each Context allocates via the Allocator passed to its constructor (default is IM3D_MALLOC/IM3D_FREE).
+typedef void *(AllocCallback)(size_t _size, size_t _align, void *_userData);
+typedef void(FreeCallback)(void *_ptr, void *_userData);
+struct Allocator
+{
+    AllocCallback *m_alloc;
+    FreeCallback *m_free;
+    void *m_userData;
+};
+
 // Minimal vector.
 template <typename T>
 class Vector
@@ -480,11 +579,20 @@ class Vector
     T *m_data = nullptr;
     U32 m_size = 0;
     U32 m_capacity = 0;
+    const Allocator *m_allocator = nullptr; // nullptr = IM3D_MALLOC/IM3D_FREE.
 
 public:
     Vector() {}
     ~Vector();
 
+    // Must be called before the first allocation.
+    void setAllocator(const Allocator *_allocator)
+    {
+        IM3D_ASSERT(m_data == nullptr);
+        m_allocator = _allocator;
+    }
+    const Allocator *getAllocator() const { return m_allocator; }
+
     T &operator[](U32 _i)
     {
         IM3D_ASSERT(_i < m_size);
@@ -507,6 +615,18 @@ public:
         }
         m_data[m_size++] = tmp;
     }
+    // Grow the size by _count without initializing the new elements, return a pointer to the first new element.
+    T *expand(U32 _count)
+    {
+        U32 sz = m_size + _count;
+        if (sz > m_capacity)
+        {
+            reserve(sz > m_capacity + m_capacity / 2 ? sz : m_capacity + m_capacity / 2);
+        }
+        T *ret = m_data + m_size;
+        m_size = sz;
+        return ret;
+    }
     void pop_back()
     {
         IM3D_ASSERT(m_size > 0);
@@ -545,12 +665,57 @@ public:
     bool empty() const { return m_size == 0; }
 
     void clear() { m_size = 0; }
+    // Forget the data without freeing it, for vectors whose allocator is reset as a whole (e.g. FrameArena).
+    void release()
+    {
+        m_data = nullptr;
+        m_size = m_capacity = 0;
+    }
     void reserve(U32 _capacity);
     void resize(U32 _size, const T &_val);
 
     static void swap(Vector<T> &_a_, Vector<T> &_b_);
 };
 
+// Linear allocator for per-frame data, reset by Context::reset(). Memory is allocated in chunks from the parent allocator; when
+// a chunk is full a new one is added so that existing allocations never move. If a frame needed more than one chunk, reset()
+// replaces them with a single chunk large enough for the whole frame, hence no heap calls are made in steady state.
+class FrameArena
+{
+public:
+    FrameArena() {}
+    ~FrameArena();
+
+    void init(const Allocator *_parent);
+    void *allocate(size_t _size, size_t _align);
+    void reset();
+
+    // Allocator interface for Vector (free is a no-op).
+    const Allocator *getAllocator() const { return &m_allocator; }
+
+    size_t getUsedBytes() const { return m_usedBytes; }         // Bytes allocated since the last reset().
+    size_t getCapacityBytes() const { return m_capacityBytes; } // Total size of all chunks.
+    U32 getChunkCount() const { return m_chunkCount; }
+
+private:
+    struct Chunk
+    {
+        Chunk *m_next;
+        size_t m_size; // Excluding the header.
+    };
+    Chunk *m_chunks = nullptr; // Current chunk first.
+    char *m_top = nullptr;     // Next free byte in the current chunk.
+    char *m_end = nullptr;     // End of the current chunk.
+    size_t m_usedBytes = 0;
+    size_t m_capacityBytes = 0;
+    U32 m_chunkCount = 0;
+    const Allocator *m_parent = nullptr;
+    Allocator m_allocator = {};
+
+    void addChunk(size_t _size);
+    void freeChunks();
+};
+
 enum PrimitiveMode
 {
     PrimitiveMode_None,
@@ -576,6 +741,19 @@ public:
     void end();
     void vertex(const Vec3 &_position, float _size, Color _color);
     void vertex(const Vec3 &_position) { vertex(_position, getSize(), getColor()); }
+    // Bulk equivalent of vertex(), _colors and/or _sizes may be null (use the current color/size).
+    void vertices(const Vec3 *_positions, const Color *_colors, const float *_sizes, U32 _count);
+    void vertices(const VertexData *_vertices, U32 _count);
+
+    // Zero-copy submission: begin a primitive and reserve _count vertices in the current vertex list, return a ptr to the reserved range.
+    // The app writes the vertex data directly (e.g. from several jobs), then calls commitVertices() which applies the matrix and alpha
+    // states as per vertex() and ends the primitive. Only Points, Lines and Triangles modes are supported. No other primitive may be
+    // started before commitVertices() (the returned ptr is invalidated).
+    VertexData *reserveVertices(PrimitiveMode _mode, U32 _count);
+    void commitVertices();
+
+    // See DrawPolyline().
+    void drawPolyline(const Vec3 *_points, const Color *_colors, U32 _count, float _pixelError);
 
     void reset();
     void merge(const Context &_src);
@@ -594,12 +772,21 @@ public:
         m_colorStack.pop_back();
     }
 
-    void setAlpha(float _alpha) { m_alphaStack.back() = _alpha; }
+    void setAlpha(float _alpha)
+    {
+        flushVertices();
+        m_alphaStack.back() = _alpha;
+    }
     float getAlpha() const { return m_alphaStack.back(); }
-    void pushAlpha(float _alpha) { m_alphaStack.push_back(_alpha); }
+    void pushAlpha(float _alpha)
+    {
+        flushVertices();
+        m_alphaStack.push_back(_alpha);
+    }
     void popAlpha()
     {
         IM3D_ASSERT(m_alphaStack.size() > 1);
+        flushVertices();
         m_alphaStack.pop_back();
     }
 
@@ -621,12 +808,30 @@ public:
     void pushLayerId(Id _layer);
     void popLayerId();
 
-    void setMatrix(const Mat4 &_mat4) { m_matrixStack.back() = _mat4; }
+    bool getCullScopeVisible() const { return m_cullScopeVisible; }
+    bool pushCullBounds(const Vec3 &_min, const Vec3 &_max);
+    void popCullBounds();
+
+    void beginRecording(Id _id);
+    void endRecording();
+    void drawRecorded(Id _id, const Mat4 *_transform); // _transform may be null (identity)
+    bool isRecording() const { return m_recordingIndex != -1; }
+
+    void setMatrix(const Mat4 &_mat4)
+    {
+        flushVertices();
+        m_matrixStack.back() = _mat4;
+    }
     const Mat4 &getMatrix() const { return m_matrixStack.back(); }
-    void pushMatrix(const Mat4 &_mat4) { m_matrixStack.push_back(_mat4); }
+    void pushMatrix(const Mat4 &_mat4)
+    {
+        flushVertices();
+        m_matrixStack.push_back(_mat4);
+    }
     void popMatrix()
     {
         IM3D_ASSERT(m_matrixStack.size() > 1);
+        flushVertices();
         m_matrixStack.pop_back();
     }
 
@@ -641,7 +846,8 @@ public:
 
     AppData &getAppData() { return m_appData; }
 
-    Context();
+    // _allocator must outlive the context, nullptr = IM3D_MALLOC/IM3D_FREE.
+    Context(const Allocator *_allocator = nullptr);
     ~Context();
 
     // low-level interface for internal and app-defined gizmos, may be subject to breaking changes
@@ -662,8 +868,14 @@ public:
     float pixelsToWorldSize(const Vec3 &_position, float _pixels);
     // Convert world space size -> pixels based on distance between _position and view origin.
     float worldSizeToPixels(const Vec3 &_position, float _pixels);
-    // Blend between _min and _max based on distance betwen _position and view origin.
+    // Blend between _min and _max based on distance betwen _position and view origin. If AppData::m_lodPixelError is set, return
+    // the segment count for a circle of radius _worldSize (transformed by the current matrix) instead, ignoring _min and _max.
     int estimateLevelOfDetail(const Vec3 &_position, float _worldSize, int _min = 4, int _max = 256);
+    // Return _detail + 1 points on the unit circle, (cos, sin) of TwoPi * i / _detail for i in [0, _detail]. Built on first use and cached
+    // per detail level; the returned ptr is valid for the lifetime of the context.
+    const Vec2 *getUnitCircle(int _detail);
+    // Return true if a sphere at _position with _radius (transformed by the current matrix) projects to fewer than AppData::m_cullMinPixelSize pixels.
+    bool isBelowMinPixelSize(const Vec3 &_position, float _radius);
 
     // Make _id hot if _depth < m_hotDepth && _intersects.
     bool makeHot(Id _id, float _depth, bool _intersects);
@@ -681,6 +893,12 @@ public:
     bool isVisible(const Vec3 &_origin, float _radius);                // sphere
     bool isVisible(const Vec3 &_min, const Vec3 &_max);                // axis-aligned box
 
+    // Rasterize occluder triangles into the occlusion buffer (see Occluders()).
+    void occluders(const Vec3 *_positions, U32 _positionStride, const U32 *_indices, U32 _indexCount);
+    // Occlusion tests, return true if the bounds are completely hidden behind the occluders submitted this frame.
+    bool isOccluded(const Vec3 &_origin, float _radius);     // sphere, transformed by the current matrix
+    bool isOccluded(const Vec3 &_min, const Vec3 &_max);     // axis-aligned box, world space
+
     // gizmo state
     bool m_gizmoLocal;     // Global mode selection for gizmos.
     GizmoMode m_gizmoMode; //               "
@@ -704,7 +922,37 @@ public:
     // Return the number of layers.
     U32 getLayerCount() const { return m_layerIdMap.size(); }
 
+    // Return the number of allocations/frees made via the context's allocator since the last call to reset() (including any
+    // made by reset() itself). Both should be 0 in steady state.
+    U32 getHeapAllocCount() const { return m_heapAllocCount; }
+    U32 getHeapFreeCount() const { return m_heapFreeCount; }
+
+    // Return the number of sorted primitive lists (per layer, per primitive type) for which the sort was skipped during the last
+    // call to endFrame(), because the sort keys were identical to the previous frame's (i.e. the view origin and sorted
+    // primitives didn't change).
+    U32 getSortSkipCount() const { return m_sortSkipCount; }
+
+    // Return the number of sorted draw lists which were merged away during the last call to endFrame() because of
+    // AppData::m_sortMergeTolerance, i.e. the draw list count without merging is GetDrawListCount() + getSortMergeCount().
+    U32 getSortMergeCount() const { return m_sortMergeCount; }
+
+    // Return the number of draw primitives (points, lines, triangles) removed by IM3D_CULL_DRAW_PRIMITIVES during the last call to endFrame().
+    U32 getCullDrawPrimitiveCount() const { return m_cullDrawPrimitiveCount; }
+
+    // Return the factor applied to AppData::m_lodPixelError to meet AppData::m_lodVertexBudget (1 = within budget).
+    float getLodErrorScale() const { return m_lodErrorScale; }
+
+    // Return the frame arena, e.g. to query its size.
+    const FrameArena &getFrameArena() const { return m_frameArena; }
+
 private:
+    // memory
+    Allocator m_parentAllocator; // Passed to the constructor.
+    Allocator m_allocator;       // Wraps m_parentAllocator to count heap calls, used for all persistent allocations.
+    U32 m_heapAllocCount;
+    U32 m_heapFreeCount;
+    FrameArena m_frameArena; // Vertex/index lists and sort data, reset by reset().
+
     // state stacks
     Vector<Color> m_colorStack;
     Vector<float> m_alphaStack;
@@ -713,24 +961,76 @@ private:
     Vector<Mat4> m_matrixStack;
     Vector<Id> m_idStack;
     Vector<Id> m_layerIdStack;
+    Vector<U32> m_layerIndexStack; // Parallel to m_layerIdStack, avoids a lookup in popLayerId().
+    Vector<bool> m_cullScopeStack; // Visibility of each cull scope, false if the scope or any parent scope was culled.
+    bool m_cullScopeVisible;       // m_cullScopeStack.back(), primitives are discarded if false.
 
     // vertex data: one list per layer, per primitive type, *2 for sorted/unsorted
-    typedef Vector<VertexData> VertexList;
-    Vector<VertexList *> m_vertexData[2]; // Each layer is DrawPrimitive_Count consecutive lists.
+    typedef Vector<DrawVertex> VertexList;
+    Vector<VertexList> m_vertexData[2];   // Each layer is DrawPrimitive_Count consecutive lists, stored by value.
+    typedef Vector<U32> IndexList;
+    Vector<IndexList> m_indexData[2];     // Parallel to m_vertexData if IM3D_INDEXED_PRIMITIVES, else empty.
+    Vector<IndexList> m_sortOrder;        // Parallel to m_vertexData[1], previous frame's sorted primitive order.
+    Vector<U64> m_sortHash;               // Parallel to m_sortOrder, hash of the sort keys m_sortOrder was computed from.
+    Vector<Vector<Vec2>> m_unitCircles;   // Indexed by detail, see getUnitCircle().
+    struct LodEntry
+    {
+        U32 m_key;                        // 0 = empty.
+        int m_detail;
+    };
+    Vector<LodEntry> m_lodHash[2];        // Open addressing hash tables of the detail chosen per shape, for the previous/current frame.
+    U32 m_lodHashIndex;                   // Index of the current frame's table in m_lodHash.
+    U32 m_lodCount;                       // # entries in m_lodHash[m_lodHashIndex].
+    float m_lodErrorScale;                // Applied to AppData::m_lodPixelError, adapted to AppData::m_lodVertexBudget by reset().
+    Vector<Id> m_recordingIds;            // Ids passed to beginRecording().
+    Vector<Vector<VertexData>> m_recordings; // DrawPrimitive_Count lists per recording (parallel to m_recordingIds), strips/loops expanded.
+    int m_recordingIndex;                 // Index in m_recordingIds of the active recording, or -1.
+    Vector<VertexData> m_recordVertices;  // Vertices of the current primitive while recording (matrix applied), see recordPrimitive().
+    Vector<Vec3> m_polylinePoints;        // drawPolyline() scratch: points transformed by the current matrix,
+    Vector<float> m_polylinePixelSize;    // world space size of a pixel at each point,
+    Vector<U32> m_polylineIndices;        // indices of the simplified points,
+    Vector<U32> m_polylineStack;          // Douglas-Peucker ranges,
+    Vector<VertexData> m_polylineVertices; // vertices of the current run.
+    U32 m_sortSkipCount;                  // # lists for which the previous frame's order was reused by sort().
+    U32 m_sortMergeCount;                 // # draw lists merged by sort() (AppData::m_sortMergeTolerance).
+    U32 m_cullDrawPrimitiveCount;         // # draw primitives removed by cullDrawPrimitives().
     int m_vertexDataIndex;                // 0, or 1 if sorting enabled.
     Vector<Id> m_layerIdMap;              // Map Id -> vertex data index.
+    Vector<U32> m_layerHash;              // Open addressing hash table for m_layerIdMap; each slot is a layer index + 1 (0 = empty).
+    mutable int m_layerCacheIndex;        // Most recent result of findLayerIndex(), or -1.
     int m_layerIndex;                     // Index of the currently active layer in m_layerIdMap.
     Vector<DrawList> m_drawLists;         // All draw lists for the current frame, available after calling endFrame() before calling reset().
     bool m_sortCalled;                    // Avoid calling sort() during every call to draw().
     bool m_endFrameCalled;                // For assert, if vertices are pushed after endFrame() was called.
+#if IM3D_VERTEX_COMPACT
+    Vec3 m_origin;                        // Origin for DrawVertex positions, captured from m_appData.m_viewOrigin in reset().
+    Vector<DrawVertex> m_primDrawVertices; // m_primVertices encoded as DrawVertex during flushVertices().
+#endif
 
     // primitive state
     PrimitiveMode m_primMode;
     DrawPrimitiveType m_primType;
     U32 m_firstVertThisPrim; // Index of the first vertex pushed during this primitive.
-    U32 m_vertCountThisPrim; // # calls to vertex() since the last call to begin().
+    U32 m_vertCountThisPrim; // # vertices written to the vertex list since the last call to begin() (including strip/loop copies unless IM3D_INDEXED_PRIMITIVES).
+    U32 m_firstIndexThisPrim; // Index of the first index pushed during this primitive (IM3D_INDEXED_PRIMITIVES only).
+    bool m_reservedThisPrim; // If the current primitive was started via reserveVertices().
+    Vector<VertexData> m_primVertices; // Vertices pushed since the last flushVertices(), before the matrix/alpha are applied.
     Vec3 m_minVertThisPrim;
     Vec3 m_maxVertThisPrim;
+#if IM3D_CULL_PRIMITIVES
+    // primitives are culled in batches by cullPrimitives(), end() records their bounds and vertex/index range
+    struct CullRecord
+    {
+        U32 m_list;        // Index in m_vertexData[m_vertexDataIndex] (and m_indexData).
+        U32 m_vertexDataIndex;
+        U32 m_firstVertex; // Vertex range [m_firstVertex, m_endVertex).
+        U32 m_endVertex;
+        U32 m_firstIndex;  // Index range [m_firstIndex, m_endIndex) if IM3D_INDEXED_PRIMITIVES.
+        U32 m_endIndex;
+    };
+    Vector<CullRecord> m_cullRecords;
+    Vector<float> m_cullBounds[6]; // Parallel to m_cullRecords, min x/y/z, max x/y/z (SoA for SIMD).
+#endif
 
     // app data
     AppData m_appData;
@@ -739,13 +1039,64 @@ private:
     Vec4 m_cullFrustum[FrustumPlane_Count]; // Optimized frustum planes from m_appData.m_cullFrustum.
     int m_cullFrustumCount;                 // # valid frustum planes in m_cullFrustum.
 
+    // occlusion culling
+    Vector<float> m_occlusionDepth;         // Nearest occluder depth (z/w) per pixel, FLT_MAX where there is no occluder.
+    Vector<float> m_occlusionTestDepth;     // Farthest m_occlusionDepth in the 3x3 neighborhood of each pixel, used by isOccluded().
+    Vector<float> m_occlusionTileDepth;     // Farthest m_occlusionTestDepth per tile.
+    U32 m_occlusionWidth;                   // Occlusion buffer size (pixels), multiples of the tile size.
+    U32 m_occlusionHeight;
+    bool m_occlusionEnabled;                // If occluders were submitted this frame.
+    bool m_occlusionTestDirty;              // If m_occlusionTestDepth/m_occlusionTileDepth need updating.
+    Vec3 m_occlusionVisibleMin;             // Last box found not occluded by isOccluded(). Boxes inside it are kept without a test, e.g. the
+    Vec3 m_occlusionVisibleMax;             // primitives of a Draw*() shape after the shape's bounds were tested.
+
+    // Update m_occlusionTestDepth/m_occlusionTileDepth from m_occlusionDepth, called by isOccluded() after occluders were submitted.
+    void updateOcclusionTest();
+
+    // Test the bounds in m_cullRecords against the cull frustum and remove culled primitives from the vertex/index lists.
+    void cullPrimitives();
+    // Test each draw primitive in the vertex/index lists against the cull frustum and remove culled ones (IM3D_CULL_DRAW_PRIMITIVES).
+    void cullDrawPrimitives();
+
     // Sort primitive data.
     void sort();
+    struct SortState; // Shared by the sort() tasks.
+    // Compute sort keys and sort m_vertexData[1][_list] (m_indexData[1][_list] if IM3D_INDEXED_PRIMITIVES).
+    void sortList(SortState &_state, U32 _list);
+    // Merge the sorted lists of _layer into runs of the same primitive type (one per draw list).
+    void partitionLayer(SortState &_state, U32 _layer);
+    static void SortListTask(U32 _list, void *_state);
+    static void PartitionLayerTask(U32 _layer, void *_state);
+
+    // m_allocator callbacks, _userData is the Context.
+    static void *HeapAlloc(size_t _size, size_t _align, void *_userData);
+    static void HeapFree(void *_ptr, void *_userData);
 
     // Return -1 if _id not found.
     int findLayerIndex(Id _id) const;
+    // Add m_layerIdMap[_layerIndex] to m_layerHash, grow m_layerHash if required.
+    void insertLayerHash(U32 _layerIndex);
+    // Return the detail stored for _key in m_lodHash[_table], or -1 if not found.
+    int findLodDetail(U32 _table, U32 _key) const;
+    // Store _detail for _key in the current frame's m_lodHash, grow it if required.
+    void insertLodDetail(U32 _key, int _detail);
 
     VertexList *getCurrentVertexList();
+    IndexList *getCurrentIndexList();
+
+    // Append _count vertices to the current primitive; strides are in bytes, a stride of 0 repeats the first element.
+    void appendVertices(
+        const Vec3 *_positions, U32 _positionStride,
+        const float *_sizes, U32 _sizeStride,
+        const Color *_colors, U32 _colorStride,
+        U32 _count);
+    // Apply the matrix/alpha to m_primVertices (SSE/AVX2 where available) and write them to the current vertex list.
+    // Called whenever the batch is full, at end() and before the matrix/alpha state changes.
+    void flushVertices();
+    // Expand m_recordVertices into the active recording as per m_primMode, called by end() while recording.
+    void recordPrimitive();
+    // Grow the current primitive's bounds for culling (no-op unless IM3D_CULL_PRIMITIVES or AppData::m_cullMinPixelSize is set).
+    void updatePrimBounds(const VertexData *_vertices, U32 _count);
 };
 
 namespace internal
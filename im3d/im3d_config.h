@@ -11,7 +11,7 @@
 // User-defined assertion handler (default is cassert assert()).
 //#define IM3D_ASSERT(e) assert(e)
 
-// User-defined malloc/free. Define both or neither (default is cstdlib malloc()/free()).
+// User-defined malloc/free for the default Allocator (see Context::Context()). Define both or neither (default is cstdlib malloc()/free()).
 //#define IM3D_MALLOC(size) malloc(size)
 //#define IM3D_FREE(ptr) free(ptr) 
 
@@ -24,9 +24,24 @@
 // Force vertex data alignment (default is 4 bytes).
 #define IM3D_VERTEX_ALIGNMENT 16
 
+// Enable SSE/AVX2 vertex transform kernels, selected at runtime (default is 1 on x86/x64). The output is identical to the scalar path.
+//#define IM3D_SIMD 0
+
+// Use a compact 16 byte vertex format for draw lists (Im3d::DrawVertex): half float position relative to the view origin + half float
+// size + rgba8. Halves the memory traffic for sorting and upload at the cost of position precision far from the view origin.
+//#define IM3D_VERTEX_COMPACT 1
+
+// Output indexed primitives: strips/loops store unique vertices plus indices instead of duplicating vertices. DrawList::m_indexData
+// must be used by the application's draw callback.
+//#define IM3D_INDEXED_PRIMITIVES 1
+
 // Enable internal culling for primitives (everything drawn between Begin*()/End()). The application must set a culling frustum via AppData.
 //#define IM3D_CULL_PRIMITIVES 1
 
+// Enable internal culling for individual draw primitives (points, lines, triangles), in a vectorized pass over the vertex lists during
+// EndFrame(). Finer grained than IM3D_CULL_PRIMITIVES and accounts for point/line size. The application must set a culling frustum via AppData.
+//#define IM3D_CULL_DRAW_PRIMITIVES 1
+
 // Enable internal culling for gizmos. The application must set a culling frustum via AppData.
 //#define IM3D_CULL_GIZMOS 1
 
@@ -3,6 +3,9 @@
 #include "im3d_math.h"
 
 static_assert(sizeof(Im3d::VertexData) == 32);
+#if IM3D_VERTEX_COMPACT
+static_assert(sizeof(Im3d::DrawVertex) == 16);
+#endif
 
 namespace Im3d
 {
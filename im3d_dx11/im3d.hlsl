@@ -24,6 +24,7 @@ struct VS_OUTPUT
 	{
 		float4x4 uViewProjMatrix;
 		float2   uViewport;
+		float3   uOrigin; // DrawList::m_origin (IM3D_VERTEX_COMPACT), else 0
 	};
 	
 	struct VS_INPUT
@@ -40,7 +41,7 @@ struct VS_OUTPUT
 			ret.m_color.a *= smoothstep(0.0, 1.0, _in.m_positionSize.w / kAntialiasing);
 		#endif
 		ret.m_size = max(_in.m_positionSize.w, kAntialiasing);
-		ret.m_position = mul(uViewProjMatrix, float4(_in.m_positionSize.xyz, 1.0));
+		ret.m_position = mul(uViewProjMatrix, float4(uOrigin + _in.m_positionSize.xyz, 1.0));
 		return ret;
 	}
 #endif
@@ -55,6 +55,7 @@ class Im3dImplDx11Impl
     ComPtr<ID3D11DepthStencilState> g_Im3dDepthStencilState;
     ComPtr<ID3D11Buffer> g_Im3dConstantBuffer;
     ComPtr<ID3D11Buffer> g_Im3dVertexBuffer;
+    ComPtr<ID3D11Buffer> g_Im3dIndexBuffer;
 
 public:
     void Draw(ID3D11DeviceContext *ctx, const float *viewProjection, int w, int h, const Im3d::DrawList *drawList, int count)
@@ -90,8 +91,13 @@ public:
 
             {
                 D3D11_INPUT_ELEMENT_DESC desc[] = {
-                    {"POSITION_SIZE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, (UINT)offsetof(Im3d::VertexData, m_positionSize), D3D11_INPUT_PER_VERTEX_DATA, 0},
-                    {"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, (UINT)offsetof(Im3d::VertexData, m_color), D3D11_INPUT_PER_VERTEX_DATA, 0},
+#if IM3D_VERTEX_COMPACT
+                    // position (relative to DrawList::m_origin) and size are packed as 4 halfs
+                    {"POSITION_SIZE", 0, DXGI_FORMAT_R16G16B16A16_FLOAT, 0, (UINT)offsetof(Im3d::DrawVertex, m_position), D3D11_INPUT_PER_VERTEX_DATA, 0},
+#else
+                    {"POSITION_SIZE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, (UINT)offsetof(Im3d::DrawVertex, m_positionSize), D3D11_INPUT_PER_VERTEX_DATA, 0},
+#endif
+                    {"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, (UINT)offsetof(Im3d::DrawVertex, m_color), D3D11_INPUT_PER_VERTEX_DATA, 0},
                 };
                 if (FAILED(d3d->CreateInputLayout(desc, 2, vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), &g_Im3dInputLayout)))
                 {
@@ -298,7 +304,7 @@ public:
         if (!g_Im3dConstantBuffer)
         {
             D3D11_BUFFER_DESC desc = {0};
-            desc.ByteWidth = sizeof(Im3d::Mat4) + sizeof(Im3d::Vec4);
+            desc.ByteWidth = sizeof(Im3d::Mat4) + sizeof(Im3d::Vec4) * 2;
             desc.Usage = D3D11_USAGE_DEFAULT;
             desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
             if (FAILED(d3d->CreateBuffer(&desc, nullptr, &g_Im3dConstantBuffer)))
@@ -314,15 +320,22 @@ public:
                 // The application may group primitives into layers, which can be used to change the draw state (e.g. enable depth testing, use a different shader)
             }
 
-            // upload view-proj matrix/viewport size
+            // upload view-proj matrix/viewport size/vertex origin
             struct Layout
             {
                 Im3d::Mat4 m_viewProj;
                 Im3d::Vec2 m_viewport;
+                Im3d::Vec2 m_pad0;
+                Im3d::Vec3 m_origin;
+                float m_pad1;
             };
             Layout layout{
                 .m_viewProj = *(const Im3d::Mat4 *)viewProjection,
-                .m_viewport = ad.m_viewportSize};
+                .m_viewport = ad.m_viewportSize,
+#if IM3D_VERTEX_COMPACT
+                .m_origin = drawList->m_origin,
+#endif
+            };
             ctx->UpdateSubresource(g_Im3dConstantBuffer.Get(), 0, nullptr, &layout, 0, 0);
 
             // upload vertex data
@@ -336,7 +349,7 @@ public:
                 s_vertexBufferSize = drawList->m_vertexCount;
 
                 D3D11_BUFFER_DESC desc = {0};
-                desc.ByteWidth = s_vertexBufferSize * sizeof(Im3d::VertexData);
+                desc.ByteWidth = s_vertexBufferSize * sizeof(Im3d::DrawVertex);
                 desc.Usage = D3D11_USAGE_DYNAMIC;
                 desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
                 desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
@@ -349,7 +362,7 @@ public:
             D3D11_MAPPED_SUBRESOURCE subRes;
             if (SUCCEEDED(ctx->Map(g_Im3dVertexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &subRes)))
             {
-                memcpy(subRes.pData, drawList->m_vertexData, drawList->m_vertexCount * sizeof(Im3d::VertexData));
+                memcpy(subRes.pData, drawList->m_vertexData, drawList->m_vertexCount * sizeof(Im3d::DrawVertex));
                 ctx->Unmap(g_Im3dVertexBuffer.Get(), 0);
             }
             else
@@ -357,6 +370,40 @@ public:
                 return;
             }
 
+            // upload index data (IM3D_INDEXED_PRIMITIVES)
+            if (drawList->m_indexData)
+            {
+                static Im3d::U32 s_indexBufferSize = 0;
+                if (!g_Im3dIndexBuffer || s_indexBufferSize < drawList->m_indexCount)
+                {
+                    if (g_Im3dIndexBuffer)
+                    {
+                        g_Im3dIndexBuffer = nullptr;
+                    }
+                    s_indexBufferSize = drawList->m_indexCount;
+
+                    D3D11_BUFFER_DESC desc = {0};
+                    desc.ByteWidth = s_indexBufferSize * sizeof(Im3d::U32);
+                    desc.Usage = D3D11_USAGE_DYNAMIC;
+                    desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+                    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+                    if (FAILED(d3d->CreateBuffer(&desc, nullptr, &g_Im3dIndexBuffer)))
+                    {
+                        return;
+                    }
+                }
+
+                if (SUCCEEDED(ctx->Map(g_Im3dIndexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &subRes)))
+                {
+                    memcpy(subRes.pData, drawList->m_indexData, drawList->m_indexCount * sizeof(Im3d::U32));
+                    ctx->Unmap(g_Im3dIndexBuffer.Get(), 0);
+                }
+                else
+                {
+                    return;
+                }
+            }
+
             ID3D11Buffer *constants[] =
                 {
                     g_Im3dConstantBuffer.Get()};
@@ -383,7 +430,7 @@ public:
                 return;
             };
 
-            UINT stride = sizeof(Im3d::VertexData);
+            UINT stride = sizeof(Im3d::DrawVertex);
             UINT offset = 0;
             ID3D11Buffer *vertexBuffers[] = {
                 g_Im3dVertexBuffer.Get(),
@@ -391,7 +438,15 @@ public:
             ctx->IASetVertexBuffers(0, _countof(vertexBuffers), vertexBuffers, &stride, &offset);
             ctx->IASetInputLayout(g_Im3dInputLayout.Get());
             ctx->VSSetConstantBuffers(0, _countof(constants), constants);
-            ctx->Draw(drawList->m_vertexCount, 0);
+            if (drawList->m_indexData)
+            {
+                ctx->IASetIndexBuffer(g_Im3dIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+                ctx->DrawIndexed(drawList->m_indexCount, 0, 0);
+            }
+            else
+            {
+                ctx->Draw(drawList->m_vertexCount, 0);
+            }
 
             ctx->VSSetShader(nullptr, nullptr, 0);
             ctx->GSSetShader(nullptr, nullptr, 0);
@@ -1,8 +1,10 @@
 #include "im3d_impl_gl3.h"
 #include "gl3_createshader.h"
 #include <GL/glew.h>
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 #include <im3d.h>
 
 
@@ -27,20 +29,39 @@ const std::string g_triangles_fs =
 #include "im3d_triangles.fs"
     ;
 
+// Inject the defines for the vertex format (IM3D_VERTEX_COMPACT) and, for indexed draw lists, reading vertices via
+// DrawList::m_indexData (IM3D_INDEXED_PRIMITIVES).
+static std::string VsVariant(const std::string &vs, bool indexed)
+{
+    std::string defines;
+#if IM3D_VERTEX_COMPACT
+    defines += "#define IM3D_VERTEX_COMPACT\n";
+#endif
+    if (indexed)
+    {
+        defines += "#define IM3D_INDEXED\n";
+    }
+    auto pos = vs.find('\n', vs.find("#version"));
+    return vs.substr(0, pos + 1) + defines + vs.substr(pos + 1);
+}
+
 class GL3Shader
 {
     GLuint m_shader;
     GLuint m_uniform;
+    GLuint m_indexUniform;
 
 public:
     GL3Shader(GLuint shader)
         : m_shader(shader)
     {
         glCreateBuffers(1, &m_uniform);
+        glCreateBuffers(1, &m_indexUniform);
     }
 
     ~GL3Shader()
     {
+        glDeleteBuffers(1, &m_indexUniform);
         glDeleteBuffers(1, &m_uniform);
         glDeleteProgram(m_shader);
     }
@@ -55,6 +76,11 @@ public:
 
         auto blockIndex = glGetUniformBlockIndex(shader, "VertexDataBlock");
         glUniformBlockBinding(shader, blockIndex, 0);
+        blockIndex = glGetUniformBlockIndex(shader, "IndexDataBlock");
+        if (blockIndex != GL_INVALID_INDEX)
+        {
+            glUniformBlockBinding(shader, blockIndex, 1);
+        }
 
         return std::make_shared<GL3Shader>(shader);
     }
@@ -69,18 +95,23 @@ public:
         glUniform2f(glGetUniformLocation(m_shader, name), x, y);
     }
 
+    void SetUniformFloat3(const char *name, float x, float y, float z)
+    {
+        glUniform3f(glGetUniformLocation(m_shader, name), x, y, z);
+    }
+
     void SetUniformMatrix(const char *name, const float *m)
     {
         glUniformMatrix4fv(glGetUniformLocation(m_shader, name), 1, false, m);
     }
 
-    void _SetUniformData(int passVertexCount, const Im3d::VertexData *vertexData)
+    void _SetUniformData(int passVertexCount, const Im3d::DrawVertex *vertexData)
     {
         glBindBuffer(GL_UNIFORM_BUFFER, m_uniform);
-        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)passVertexCount * sizeof(Im3d::VertexData), (GLvoid *)vertexData, GL_DYNAMIC_DRAW);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)passVertexCount * sizeof(Im3d::DrawVertex), (GLvoid *)vertexData, GL_DYNAMIC_DRAW);
     }
 
-    int DrawPoints(int passVertexCount, const Im3d::VertexData *vertexData)
+    int DrawPoints(int passVertexCount, const Im3d::DrawVertex *vertexData)
     {
         _SetUniformData(passVertexCount, vertexData);
 
@@ -91,7 +122,7 @@ public:
         return passVertexCount;
     }
 
-    void DrawLines(int passVertexCount, const Im3d::VertexData *vertexData)
+    void DrawLines(int passVertexCount, const Im3d::DrawVertex *vertexData)
     {
         _SetUniformData(passVertexCount, vertexData);
 
@@ -100,7 +131,7 @@ public:
         glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, passVertexCount / 2); // for triangles just use the first 3 verts of the strip
     }
 
-    void DrawTriangles(int passVertexCount, const Im3d::VertexData *vertexData)
+    void DrawTriangles(int passVertexCount, const Im3d::DrawVertex *vertexData)
     {
         _SetUniformData(passVertexCount, vertexData);
 
@@ -108,6 +139,32 @@ public:
         glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_uniform);
         glDrawArraysInstanced(GL_TRIANGLES, 0, 3, passVertexCount / 3); // for triangles just use the first 3 verts of the strip
     }
+
+    // indexData must be padded to a multiple of 4 indices (the shader reads them as uvec4).
+    void DrawIndexed(Im3d::DrawPrimitiveType primType, int passVertexCount, const Im3d::DrawVertex *vertexData, int passIndexCount, const Im3d::U32 *indexData)
+    {
+        _SetUniformData(passVertexCount, vertexData);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_indexUniform);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)((passIndexCount + 3) & ~3) * sizeof(Im3d::U32), (GLvoid *)indexData, GL_DYNAMIC_DRAW);
+
+        // instanced draw call, 1 instance per prim
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_uniform);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 1, m_indexUniform);
+        switch (primType)
+        {
+        case Im3d::DrawPrimitive_Points:
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, passIndexCount);
+            break;
+        case Im3d::DrawPrimitive_Lines:
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, passIndexCount / 2);
+            break;
+        case Im3d::DrawPrimitive_Triangles:
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 3, passIndexCount / 3);
+            break;
+        default:
+            break;
+        }
+    }
 };
 
 class GL3Mesh
@@ -155,6 +212,9 @@ public:
 std::shared_ptr<GL3Shader> g_Im3dShaderPoints;
 std::shared_ptr<GL3Shader> g_Im3dShaderLines;
 std::shared_ptr<GL3Shader> g_Im3dShaderTriangles;
+std::shared_ptr<GL3Shader> g_Im3dShaderPointsIndexed;
+std::shared_ptr<GL3Shader> g_Im3dShaderLinesIndexed;
+std::shared_ptr<GL3Shader> g_Im3dShaderTrianglesIndexed;
 std::shared_ptr<GL3Mesh> g_Im3dVertexArray;
 
 
@@ -168,6 +228,9 @@ void Im3d_GL3_Finalize()
     g_Im3dShaderPoints.reset();
     g_Im3dShaderLines.reset();
     g_Im3dShaderTriangles.reset();
+    g_Im3dShaderPointsIndexed.reset();
+    g_Im3dShaderLinesIndexed.reset();
+    g_Im3dShaderTrianglesIndexed.reset();
     g_Im3dVertexArray.reset();
 }
 
@@ -187,32 +250,66 @@ void Im3d_GL3_Draw(const float *viewProjection, int w, int h, const struct Im3d:
         }
 
         std::shared_ptr<GL3Shader> sh;
+        const bool indexed = drawList->m_indexData != nullptr;
         switch (drawList->m_primType)
         {
         case Im3d::DrawPrimitive_Points:
-            if (!g_Im3dShaderPoints)
+            if (indexed)
+            {
+                if (!g_Im3dShaderPointsIndexed)
+                {
+                    g_Im3dShaderPointsIndexed = GL3Shader::Create(VsVariant(g_points_vs, true), g_points_fs);
+                }
+                sh = g_Im3dShaderPointsIndexed;
+            }
+            else
             {
-                g_Im3dShaderPoints = GL3Shader::Create(g_points_vs, g_points_fs);
+                if (!g_Im3dShaderPoints)
+                {
+                    g_Im3dShaderPoints = GL3Shader::Create(VsVariant(g_points_vs, false), g_points_fs);
+                }
+                sh = g_Im3dShaderPoints;
             }
-            sh = g_Im3dShaderPoints;
             glDisable(GL_CULL_FACE); // points are view-aligned
             break;
 
         case Im3d::DrawPrimitive_Lines:
-            if (!g_Im3dShaderLines)
+            if (indexed)
             {
-                g_Im3dShaderLines = GL3Shader::Create(g_lines_vs, g_lines_fs);
+                if (!g_Im3dShaderLinesIndexed)
+                {
+                    g_Im3dShaderLinesIndexed = GL3Shader::Create(VsVariant(g_lines_vs, true), g_lines_fs);
+                }
+                sh = g_Im3dShaderLinesIndexed;
+            }
+            else
+            {
+                if (!g_Im3dShaderLines)
+                {
+                    g_Im3dShaderLines = GL3Shader::Create(VsVariant(g_lines_vs, false), g_lines_fs);
+                }
+                sh = g_Im3dShaderLines;
             }
-            sh = g_Im3dShaderLines;
             glDisable(GL_CULL_FACE); // lines are view-aligned
             break;
 
         case Im3d::DrawPrimitive_Triangles:
-            if (!g_Im3dShaderTriangles)
+            if (indexed)
             {
-                g_Im3dShaderTriangles = GL3Shader::Create(g_triangles_vs, g_triangles_fs);
+                if (!g_Im3dShaderTrianglesIndexed)
+                {
+                    g_Im3dShaderTrianglesIndexed = GL3Shader::Create(VsVariant(g_triangles_vs, true), g_triangles_fs);
+                }
+                sh = g_Im3dShaderTrianglesIndexed;
+            }
+            else
+            {
+                if (!g_Im3dShaderTriangles)
+                {
+                    g_Im3dShaderTriangles = GL3Shader::Create(VsVariant(g_triangles_vs, false), g_triangles_fs);
+                }
+                sh = g_Im3dShaderTriangles;
             }
-            sh = g_Im3dShaderTriangles;
             glEnable(GL_CULL_FACE); // culling valid for triangles, but optional
             break;
 
@@ -238,12 +335,82 @@ void Im3d_GL3_Draw(const float *viewProjection, int w, int h, const struct Im3d:
         auto &ad = Im3d::GetAppData();
         sh->SetUniformFloat2("uViewport", ad.m_viewportSize.x, ad.m_viewportSize.y);
         sh->SetUniformMatrix("uViewProjMatrix", viewProjection);
+#if IM3D_VERTEX_COMPACT
+        sh->SetUniformFloat3("uOrigin", drawList->m_origin.x, drawList->m_origin.y, drawList->m_origin.z);
+#endif
 
         // Uniform buffers have a size limit; split the vertex data into several passes.
         const int kMaxBufferSize = 64 * 1024; // assuming 64kb here but the application should check the implementation limit
-        const int kVertexPerPass = kMaxBufferSize / (sizeof(Im3d::VertexData));
+        const int kVertexPerPass = kMaxBufferSize / (sizeof(Im3d::DrawVertex));
+
+        if (indexed)
+        {
+            // Each pass uploads the range of vertices referenced by its primitives, plus the indices rebased to the start of the range.
+            // Strips/loops reference nearby vertices so the range is usually small.
+            const int kIndexPerPass = kMaxBufferSize / sizeof(Im3d::U32);
+            const int primSize = drawList->m_primType == Im3d::DrawPrimitive_Points ? 1 : (drawList->m_primType == Im3d::DrawPrimitive_Lines ? 2 : 3);
+            static std::vector<Im3d::U32> s_passIndexData;
+            static std::vector<Im3d::DrawVertex> s_passVertexData;
+
+            const Im3d::U32 *indexData = drawList->m_indexData;
+            int remainingIndexCount = (int)drawList->m_indexCount;
+            while (remainingIndexCount > 0)
+            {
+                Im3d::U32 lo = ~0u;
+                Im3d::U32 hi = 0;
+                int passIndexCount = 0;
+                while (passIndexCount < remainingIndexCount && passIndexCount + primSize <= kIndexPerPass)
+                {
+                    Im3d::U32 primLo = lo;
+                    Im3d::U32 primHi = hi;
+                    for (int j = 0; j < primSize; ++j)
+                    {
+                        primLo = std::min(primLo, indexData[passIndexCount + j]);
+                        primHi = std::max(primHi, indexData[passIndexCount + j]);
+                    }
+                    if (primHi - primLo >= (Im3d::U32)kVertexPerPass)
+                    {
+                        break;
+                    }
+                    lo = primLo;
+                    hi = primHi;
+                    passIndexCount += primSize;
+                }
+
+                const Im3d::DrawVertex *passVertexData;
+                s_passIndexData.clear();
+                if (passIndexCount == 0)
+                {
+                    // a single primitive spans more than kVertexPerPass vertices (e.g. the closing line of a large loop), copy its vertices
+                    s_passVertexData.clear();
+                    for (int j = 0; j < primSize; ++j)
+                    {
+                        s_passVertexData.push_back(drawList->m_vertexData[indexData[j]]);
+                        s_passIndexData.push_back((Im3d::U32)j);
+                    }
+                    passIndexCount = primSize;
+                    passVertexData = s_passVertexData.data();
+                    lo = 0;
+                    hi = primSize - 1;
+                }
+                else
+                {
+                    for (int j = 0; j < passIndexCount; ++j)
+                    {
+                        s_passIndexData.push_back(indexData[j] - lo);
+                    }
+                    passVertexData = drawList->m_vertexData + lo;
+                }
+                s_passIndexData.resize((passIndexCount + 3) & ~3, 0);
+                sh->DrawIndexed(drawList->m_primType, (int)(hi - lo + 1), passVertexData, passIndexCount, s_passIndexData.data());
+
+                indexData += passIndexCount;
+                remainingIndexCount -= passIndexCount;
+            }
+            continue;
+        }
 
-        const Im3d::VertexData *vertexData = drawList->m_vertexData;
+        const Im3d::DrawVertex *vertexData = drawList->m_vertexData;
         auto remainingVertexCount = drawList->m_vertexCount;
         while (remainingVertexCount > 0)
         {
@@ -19,6 +19,33 @@ R""(
 	See im3d_opengl31.cpp for more details.
 */
 
+#ifdef IM3D_VERTEX_COMPACT
+uniform VertexDataBlock
+{
+    uvec4 uVertexData[(64 * 1024) / 16]; // assume a 64kb block size, 16 is the size of DrawVertex
+};
+uniform vec3 uOrigin; // DrawList::m_origin, compact vertex positions are relative to this
+
+// GLSL 1.40 has no unpackHalf2x16(), inf/nan are not handled.
+float HalfToFloat(uint _h)
+{
+    uint e = (_h >> 10u) & 0x1fu;
+    float m = float(_h & 0x3ffu);
+    float ret = (e == 0u) ? m * exp2(-24.0) : (1.0 + m / 1024.0) * exp2(float(e) - 15.0);
+    return ((_h & 0x8000u) != 0u) ? -ret : ret;
+}
+vec4 GetPositionSize(int _vid)
+{
+    uvec4 v = uVertexData[_vid];
+    return vec4(
+        uOrigin + vec3(HalfToFloat(v.x & 0xffffu), HalfToFloat(v.x >> 16u), HalfToFloat(v.y & 0xffffu)),
+        HalfToFloat(v.y >> 16u));
+}
+uint GetColor(int _vid)
+{
+    return uVertexData[_vid].z;
+}
+#else
 struct VertexData
 {
     vec4 m_positionSize;
@@ -28,6 +55,30 @@ uniform VertexDataBlock
 {
     VertexData uVertexData[(64 * 1024) / 32]; // assume a 64kb block size, 32 is the aligned size of VertexData
 };
+vec4 GetPositionSize(int _vid)
+{
+    return uVertexData[_vid].m_positionSize;
+}
+uint GetColor(int _vid)
+{
+    return uVertexData[_vid].m_color;
+}
+#endif
+#ifdef IM3D_INDEXED
+uniform IndexDataBlock
+{
+    uvec4 uIndexData[(64 * 1024) / 16]; // 4 indices per element (std140 arrays have a 16 byte stride)
+};
+int VertexIndex(int _i)
+{
+    return int(uIndexData[_i / 4][_i % 4]);
+}
+#else
+int VertexIndex(int _i)
+{
+    return _i;
+}
+#endif
 
 uniform mat4 uViewProjMatrix;
 uniform vec2 uViewport;
@@ -50,18 +101,18 @@ vec4 UintToRgba(uint _u)
 
 void main()
 {
-    int vid0 = gl_InstanceID * 2;                   // line start
-    int vid1 = vid0 + 1;                            // line end
+    int vid0 = VertexIndex(gl_InstanceID * 2);      // line start
+    int vid1 = VertexIndex(gl_InstanceID * 2 + 1);  // line end
     int vid = (gl_VertexID % 2 == 0) ? vid0 : vid1; // data for this vertex
 
-    vColor = UintToRgba(uVertexData[vid].m_color);
-    vSize = uVertexData[vid].m_positionSize.w;
+    vColor = UintToRgba(GetColor(vid));
+    vSize = GetPositionSize(vid).w;
     vColor.a *= smoothstep(0.0, 1.0, vSize / kAntialiasing);
     vSize = max(vSize, kAntialiasing);
     vEdgeDistance = vSize * aPosition.y;
 
-    vec4 pos0 = uViewProjMatrix * vec4(uVertexData[vid0].m_positionSize.xyz, 1.0);
-    vec4 pos1 = uViewProjMatrix * vec4(uVertexData[vid1].m_positionSize.xyz, 1.0);
+    vec4 pos0 = uViewProjMatrix * vec4(GetPositionSize(vid0).xyz, 1.0);
+    vec4 pos1 = uViewProjMatrix * vec4(GetPositionSize(vid1).xyz, 1.0);
     vec2 dir = (pos0.xy / pos0.w) - (pos1.xy / pos1.w);
     dir = normalize(vec2(dir.x, dir.y * uViewport.y / uViewport.x)); // correct for aspect ratio
     vec2 tng = vec2(-dir.y, dir.x) * vSize / uViewport;
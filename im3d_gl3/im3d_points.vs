@@ -19,6 +19,33 @@ R""(
 	See im3d_opengl31.cpp for more details.
 */
 
+#ifdef IM3D_VERTEX_COMPACT
+uniform VertexDataBlock
+{
+    uvec4 uVertexData[(64 * 1024) / 16]; // assume a 64kb block size, 16 is the size of DrawVertex
+};
+uniform vec3 uOrigin; // DrawList::m_origin, compact vertex positions are relative to this
+
+// GLSL 1.40 has no unpackHalf2x16(), inf/nan are not handled.
+float HalfToFloat(uint _h)
+{
+    uint e = (_h >> 10u) & 0x1fu;
+    float m = float(_h & 0x3ffu);
+    float ret = (e == 0u) ? m * exp2(-24.0) : (1.0 + m / 1024.0) * exp2(float(e) - 15.0);
+    return ((_h & 0x8000u) != 0u) ? -ret : ret;
+}
+vec4 GetPositionSize(int _vid)
+{
+    uvec4 v = uVertexData[_vid];
+    return vec4(
+        uOrigin + vec3(HalfToFloat(v.x & 0xffffu), HalfToFloat(v.x >> 16u), HalfToFloat(v.y & 0xffffu)),
+        HalfToFloat(v.y >> 16u));
+}
+uint GetColor(int _vid)
+{
+    return uVertexData[_vid].z;
+}
+#else
 struct VertexData
 {
     vec4 m_positionSize;
@@ -28,6 +55,30 @@ uniform VertexDataBlock
 {
     VertexData uVertexData[(64 * 1024) / 32]; // assume a 64kb block size, 32 is the aligned size of VertexData
 };
+vec4 GetPositionSize(int _vid)
+{
+    return uVertexData[_vid].m_positionSize;
+}
+uint GetColor(int _vid)
+{
+    return uVertexData[_vid].m_color;
+}
+#endif
+#ifdef IM3D_INDEXED
+uniform IndexDataBlock
+{
+    uvec4 uIndexData[(64 * 1024) / 16]; // 4 indices per element (std140 arrays have a 16 byte stride)
+};
+int VertexIndex(int _i)
+{
+    return int(uIndexData[_i / 4][_i % 4]);
+}
+#else
+int VertexIndex(int _i)
+{
+    return _i;
+}
+#endif
 
 uniform mat4 uViewProjMatrix;
 uniform vec2 uViewport;
@@ -50,13 +101,13 @@ vec4 UintToRgba(uint _u)
 
 void main()
 {
-    int vid = gl_InstanceID;
+    int vid = VertexIndex(gl_InstanceID);
 
-    vSize = max(uVertexData[vid].m_positionSize.w, kAntialiasing);
-    vColor = UintToRgba(uVertexData[vid].m_color);
+    vSize = max(GetPositionSize(vid).w, kAntialiasing);
+    vColor = UintToRgba(GetColor(vid));
     vColor.a *= smoothstep(0.0, 1.0, vSize / kAntialiasing);
 
-    gl_Position = uViewProjMatrix * vec4(uVertexData[vid].m_positionSize.xyz, 1.0);
+    gl_Position = uViewProjMatrix * vec4(GetPositionSize(vid).xyz, 1.0);
     vec2 scale = 1.0 / uViewport * vSize;
     gl_Position.xy += aPosition.xy * scale * gl_Position.w;
     vUv = aPosition.xy * 0.5 + 0.5;
@@ -0,0 +1,65 @@
+// Shared helpers for the benchmarks and tests in this directory. They run without a window or graphics device: each program
+// fills AppData, submits geometry and inspects the draw lists after EndFrame().
+#pragma once
+
+#include <im3d.h>
+#include <im3d_math.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace bench
+{
+
+// Wall clock time in milliseconds since construction or the last call to reset().
+class Timer
+{
+    std::chrono::high_resolution_clock::time_point m_start;
+
+public:
+    Timer() { reset(); }
+    void reset() { m_start = std::chrono::high_resolution_clock::now(); }
+    double ms() const { return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_start).count(); }
+};
+
+// Perspective camera at _eye looking at _target with a 640x480 viewport. Fills the view/projection fields of AppData, the cull
+// frustum and the occlusion view-projection (D3D style, z in [0,1]); returns the view-projection matrix.
+inline Im3d::Mat4 SetupView(const Im3d::Vec3 &_eye, const Im3d::Vec3 &_target, float _fovY = 0.8f, float _near = 0.1f, float _far = 200.0f)
+{
+    using namespace Im3d;
+    AppData &ad = GetAppData();
+    ad.m_viewportSize = Vec2(640.0f, 480.0f);
+    ad.m_projOrtho = false;
+    ad.m_projScaleY = tanf(_fovY * 0.5f);
+    ad.m_viewOrigin = _eye;
+    ad.m_viewDirection = Normalize(_target - _eye);
+    ad.m_worldUp = Vec3(0.0f, 1.0f, 0.0f);
+    ad.m_cursorRayOrigin = ad.m_viewOrigin;
+    ad.m_cursorRayDirection = ad.m_viewDirection;
+    ad.m_deltaTime = 1.0f / 60.0f;
+
+    const float fy = 1.0f / ad.m_projScaleY;
+    const float fx = fy * ad.m_viewportSize.y / ad.m_viewportSize.x;
+    const Mat4 proj(
+        fx, 0.0f, 0.0f, 0.0f,
+        0.0f, fy, 0.0f, 0.0f,
+        0.0f, 0.0f, _far / (_far - _near), -_near * _far / (_far - _near),
+        0.0f, 0.0f, 1.0f, 0.0f);
+    const Mat4 viewProj = proj * Inverse(LookAt(_eye, _target, ad.m_worldUp));
+    ad.setCullFrustum(viewProj, false);
+    ad.m_occlusionViewProj = viewProj;
+    return viewProj;
+}
+
+// Total # vertices in the draw lists of the last EndFrame().
+inline Im3d::U32 CountVertices()
+{
+    Im3d::U32 ret = 0;
+    for (Im3d::U32 i = 0; i < Im3d::GetDrawListCount(); ++i)
+    {
+        ret += Im3d::GetDrawLists()[i].m_vertexCount;
+    }
+    return ret;
+}
+
+} // namespace bench
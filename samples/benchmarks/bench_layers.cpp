@@ -0,0 +1,49 @@
+// PushLayerId()/PopLayerId() with 1k layers: 100k push/pop pairs in random order, and grouped (100 consecutive pairs per
+// layer, as when pushing a layer around each entity of a category).
+#include "bench_common.h"
+
+using namespace Im3d;
+
+int main(int, char **)
+{
+    const int kLayerCount = 1000;
+    const int kPairCount = 100000;
+
+    bench::SetupView(Vec3(0.0f, 2.0f, -8.0f), Vec3(0.0f));
+    NewFrame();
+    for (int i = 0; i < kLayerCount; ++i)
+    {
+        PushLayerId(MakeId(i));
+        PopLayerId();
+    }
+
+    // min of 5 runs
+    double randomMs = 1e9;
+    double groupedMs = 1e9;
+    U32 rng = 1;
+    for (int run = 0; run < 5; ++run)
+    {
+        bench::Timer timer;
+        for (int i = 0; i < kPairCount; ++i)
+        {
+            rng = rng * 1664525u + 1013904223u; // LCG
+            PushLayerId(MakeId((int)((rng >> 8) % kLayerCount)));
+            PopLayerId();
+        }
+        double ms = timer.ms();
+        randomMs = ms < randomMs ? ms : randomMs;
+
+        timer.reset();
+        for (int i = 0; i < kPairCount; ++i)
+        {
+            PushLayerId(MakeId(i / 100 % kLayerCount));
+            PopLayerId();
+        }
+        ms = timer.ms();
+        groupedMs = ms < groupedMs ? ms : groupedMs;
+    }
+    EndFrame();
+
+    printf("%d layers, %dk push/pop pairs: random %.2fms, grouped %.2fms\n", kLayerCount, kPairCount / 1000, randomMs, groupedMs);
+    return 0;
+}
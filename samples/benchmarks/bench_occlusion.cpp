@@ -0,0 +1,69 @@
+// Occlusion culling: 20k shapes (DrawSphere(), DrawAlignedBox() and a line each) per frame, behind the teapot and in front of it,
+// with and without the teapot submitted via Occluders(). Reports the frame time (NewFrame() to EndFrame()) and the vertex count.
+#include "bench_common.h"
+#include <teapot.h>
+#include <random>
+#include <vector>
+
+using namespace Im3d;
+
+namespace
+{
+
+const U32 kTeapotIndexCount = sizeof(s_teapotIndices) / sizeof(s_teapotIndices[0]);
+const U32 kTeapotVertexStride = sizeof(float) * 6; // position, normal
+
+void Run(const char *_name, const std::vector<Vec3> &_centers, bool _occluders)
+{
+    const Vec3 eye(0.3f, 1.2f, -4.0f);
+    const Mat4 model(Vec3(0.0f), Mat3(1.0f), Vec3(8.0f));
+    double frameMs = 1e9;
+    for (int frame = 0; frame < 20; ++frame)
+    {
+        bench::SetupView(eye, Vec3(0.0f, 0.6f, 0.0f), 0.8f, 0.1f, 100.0f);
+        bench::Timer timer;
+        NewFrame();
+        if (_occluders)
+        {
+            PushMatrix(model);
+            Occluders((const Vec3 *)s_teapotVertices, kTeapotVertexStride, s_teapotIndices, kTeapotIndexCount);
+            PopMatrix();
+        }
+        for (const Vec3 &p : _centers)
+        {
+            DrawSphere(p, 0.05f);
+            DrawAlignedBox(p - Vec3(0.04f), p + Vec3(0.04f));
+            BeginLines();
+            Vertex(p);
+            Vertex(p + Vec3(0.0f, 0.1f, 0.0f));
+            End();
+        }
+        EndFrame();
+        double ms = timer.ms();
+        frameMs = ms < frameMs ? ms : frameMs;
+    }
+    printf("  %-6s %-18s %7.2fms, %8u vertices\n", _name, _occluders ? "with occluders:" : "without occluders:", frameMs, bench::CountVertices());
+}
+
+} // namespace
+
+int main(int, char **)
+{
+    const int kShapeCount = 20000;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> x(-1.25f, 1.25f), y(0.05f, 1.55f), z(2.0f, 4.5f);
+    std::vector<Vec3> behind, front;
+    for (int i = 0; i < kShapeCount; ++i)
+    {
+        Vec3 p(x(rng), y(rng), z(rng));
+        behind.push_back(p);
+        front.push_back(p - Vec3(0.0f, 0.0f, 6.0f)); // between the eye and the teapot
+    }
+
+    printf("%dk shapes:\n", kShapeCount / 1000);
+    Run("behind", behind, false);
+    Run("behind", behind, true);
+    Run("front", front, false);
+    Run("front", front, true);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// DrawSphere() with the cached unit circle tables vs a reference which calls cosf/sinf per vertex (as DrawSphere() did before):
+// checks that both produce the same vertices, then times 10k spheres per frame at automatic and fixed detail.
+#include "bench_common.h"
+#include <vector>
+
+using namespace Im3d;
+
+namespace
+{
+
+const int kSphereCount = 10000;
+
+// DrawSphere() without the circle table (and without the culling/level of detail, _detail must be >= 3).
+void DrawSphereReference(const Vec3 &_origin, float _radius, int _detail)
+{
+    // xy circle
+    BeginLineLoop();
+    for (int i = 0; i < _detail; ++i)
+    {
+        float rad = TwoPi * ((float)i / (float)_detail);
+        Vertex(Vec3(cosf(rad) * _radius + _origin.x, sinf(rad) * _radius + _origin.y, 0.0f + _origin.z));
+    }
+    End();
+    // xz circle
+    BeginLineLoop();
+    for (int i = 0; i < _detail; ++i)
+    {
+        float rad = TwoPi * ((float)i / (float)_detail);
+        Vertex(Vec3(cosf(rad) * _radius + _origin.x, 0.0f + _origin.y, sinf(rad) * _radius + _origin.z));
+    }
+    End();
+    // yz circle
+    BeginLineLoop();
+    for (int i = 0; i < _detail; ++i)
+    {
+        float rad = TwoPi * ((float)i / (float)_detail);
+        Vertex(Vec3(0.0f + _origin.x, cosf(rad) * _radius + _origin.y, sinf(rad) * _radius + _origin.z));
+    }
+    End();
+}
+
+Vec3 SphereOrigin(int _i)
+{
+    return Vec3((float)(_i % 100) - 50.0f, (float)(_i / 100) * 0.1f, (float)(_i / 100) - 50.0f);
+}
+
+void BeginView()
+{
+    bench::SetupView(Vec3(0.0f, 40.0f, -90.0f), Vec3(0.0f));
+    NewFrame();
+}
+
+std::vector<Vec3> CapturePositions()
+{
+    std::vector<Vec3> ret;
+    for (U32 i = 0; i < GetDrawListCount(); ++i)
+    {
+        const DrawList &dl = GetDrawLists()[i];
+        for (U32 j = 0; j < dl.m_vertexCount; ++j)
+        {
+#if IM3D_VERTEX_COMPACT
+            ret.push_back(dl.m_vertexData[j].getPosition() + dl.m_origin);
+#else
+            ret.push_back(Vec3(dl.m_vertexData[j].m_positionSize));
+#endif
+        }
+    }
+    return ret;
+}
+
+// Min time of 30 frames to submit kSphereCount spheres.
+template <typename DRAW>
+double TimeSpheres(DRAW _draw)
+{
+    double ret = 1e9;
+    for (int frame = 0; frame < 30; ++frame)
+    {
+        BeginView();
+        bench::Timer timer;
+        for (int i = 0; i < kSphereCount; ++i)
+        {
+            _draw(SphereOrigin(i));
+        }
+        double ms = timer.ms();
+        ret = ms < ret ? ms : ret;
+        EndFrame();
+    }
+    return ret;
+}
+
+} // namespace
+
+int main(int, char **)
+{
+    // correctness
+    int failures = 0;
+    for (int detail = 3; detail <= 128; detail = detail * 2 + 1)
+    {
+        BeginView();
+        for (int i = 0; i < 100; ++i)
+        {
+            DrawSphereReference(SphereOrigin(i * 97), 0.5f, detail);
+        }
+        EndFrame();
+        std::vector<Vec3> ref = CapturePositions();
+        BeginView();
+        for (int i = 0; i < 100; ++i)
+        {
+            DrawSphere(SphereOrigin(i * 97), 0.5f, detail);
+        }
+        EndFrame();
+        std::vector<Vec3> table = CapturePositions();
+        float maxError = 0.0f;
+        for (size_t i = 0; i < ref.size() && i < table.size(); ++i)
+        {
+            float err = Length(ref[i] - table[i]);
+            maxError = err > maxError ? err : maxError;
+        }
+        if (ref.size() != table.size() || maxError > 1e-4f)
+        {
+            printf("FAILED: detail %d, %u vs %u vertices, max error %g\n", detail, (U32)ref.size(), (U32)table.size(), maxError);
+            ++failures;
+        }
+    }
+    printf("correctness: %d failures\n", failures);
+
+    // benchmark
+    printf("%dk DrawSphere() per frame:\n", kSphereCount / 1000);
+    printf("  auto detail: %.2fms\n", TimeSpheres([](const Vec3 &_origin) { DrawSphere(_origin, 0.5f); }));
+    for (int detail : {8, 32, 128})
+    {
+        double refMs = TimeSpheres([detail](const Vec3 &_origin) { DrawSphereReference(_origin, 0.5f, detail); });
+        double tableMs = TimeSpheres([detail](const Vec3 &_origin) { DrawSphere(_origin, 0.5f, detail); });
+        printf("  detail %3d: cosf/sinf %.2fms, circle table %.2fms\n", detail, refMs, tableMs);
+    }
+    return failures == 0 ? 0 : 1;
+}
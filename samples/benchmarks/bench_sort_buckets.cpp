@@ -0,0 +1,144 @@
+// AppData::m_sortBucketCount: EndFrame() with 200k sorted triangles + 25k sorted lines under an orbiting camera, exact sort vs
+// bucketed sort. The sorting error is measured on the draw lists as the fraction of inverted primitive pairs (a nearer primitive
+// drawn before a farther one) and the max relative depth error of a primitive drawn after a nearer one.
+#include "bench_common.h"
+#include <random>
+#include <vector>
+
+using namespace Im3d;
+
+namespace
+{
+
+// Count the pairs i < j with _data_[i] < _data_[j] (merge sort, _data_ is sorted descending on return).
+unsigned long long CountInversions(std::vector<float> &_data_, std::vector<float> &_scratch, size_t _begin, size_t _end)
+{
+    if (_end - _begin < 2)
+    {
+        return 0;
+    }
+    size_t mid = (_begin + _end) / 2;
+    unsigned long long ret = CountInversions(_data_, _scratch, _begin, mid) + CountInversions(_data_, _scratch, mid, _end);
+    size_t i = _begin, j = mid, k = _begin;
+    while (i < mid && j < _end)
+    {
+        if (_data_[i] >= _data_[j])
+        {
+            _scratch[k++] = _data_[i++];
+        }
+        else
+        {
+            ret += mid - i;
+            _scratch[k++] = _data_[j++];
+        }
+    }
+    while (i < mid)
+    {
+        _scratch[k++] = _data_[i++];
+    }
+    while (j < _end)
+    {
+        _scratch[k++] = _data_[j++];
+    }
+    for (k = _begin; k < _end; ++k)
+    {
+        _data_[k] = _scratch[k];
+    }
+    return ret;
+}
+
+// Distance from _eye to each primitive in the draw lists, in draw order (RMS of the vertex distances, as the sort key).
+std::vector<float> PrimitiveDistances(const Vec3 &_eye)
+{
+    std::vector<float> ret;
+    for (U32 i = 0; i < GetDrawListCount(); ++i)
+    {
+        const DrawList &dl = GetDrawLists()[i];
+        const U32 primSize = dl.m_primType == DrawPrimitive_Triangles ? 3 : (dl.m_primType == DrawPrimitive_Lines ? 2 : 1);
+        const U32 count = dl.m_indexData ? dl.m_indexCount : dl.m_vertexCount;
+        for (U32 j = 0; j < count; j += primSize)
+        {
+            float d2 = 0.0f;
+            for (U32 k = 0; k < primSize; ++k)
+            {
+                const DrawVertex &v = dl.m_indexData ? dl.m_vertexData[dl.m_indexData[j + k]] : dl.m_vertexData[j + k];
+#if IM3D_VERTEX_COMPACT
+                Vec3 p = v.getPosition() + dl.m_origin;
+#else
+                Vec3 p = Vec3(v.m_positionSize);
+#endif
+                d2 += Length2(p - _eye);
+            }
+            ret.push_back(sqrtf(d2 / primSize));
+        }
+    }
+    return ret;
+}
+
+} // namespace
+
+int main(int, char **)
+{
+    const U32 kTriangleCount = 200000;
+    const U32 kLineCount = kTriangleCount / 8;
+    const int kFrameCount = 20;
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> pos(-50.0f, 50.0f);
+    std::vector<Vec3> triangles(kTriangleCount * 3);
+    for (U32 i = 0; i < kTriangleCount; ++i)
+    {
+        Vec3 center(pos(rng), pos(rng), pos(rng));
+        for (U32 j = 0; j < 3; ++j)
+        {
+            triangles[i * 3 + j] = center + Vec3(pos(rng), pos(rng), pos(rng)) * 0.02f;
+        }
+    }
+
+    printf("%uk triangles + %uk lines, near 0.1, far 200, %d frames:\n", kTriangleCount / 1000, kLineCount / 1000, kFrameCount);
+    for (U32 bucketCount : {0u, 64u, 256u, 1024u, 4096u, 16384u})
+    {
+        GetAppData().m_sortBucketCount = bucketCount;
+        double endFrameMs = 1e9;
+        double invertedPairs = 0.0;
+        double maxDepthError = 0.0;
+        U32 drawListCount = 0;
+        for (int frame = 0; frame < kFrameCount; ++frame)
+        {
+            float t = frame * 0.05f;
+            Vec3 eye(sinf(t) * 80.0f, 10.0f, -cosf(t) * 80.0f);
+            bench::SetupView(eye, Vec3(0.0f));
+            NewFrame();
+            PushEnableSorting(true);
+            BeginTriangles();
+            Vertices(triangles.data(), nullptr, nullptr, kTriangleCount * 3);
+            End();
+            BeginLines();
+            Vertices(triangles.data(), nullptr, nullptr, kLineCount * 2);
+            End();
+            PopEnableSorting();
+            bench::Timer timer;
+            EndFrame();
+            double ms = timer.ms();
+            endFrameMs = ms < endFrameMs ? ms : endFrameMs;
+            drawListCount = GetDrawListCount();
+
+            std::vector<float> dist = PrimitiveDistances(eye);
+            float nearest = INFINITY;
+            for (float d : dist)
+            {
+                if (d > nearest)
+                {
+                    double err = (double)(d - nearest) / d;
+                    maxDepthError = err > maxDepthError ? err : maxDepthError;
+                }
+                nearest = d < nearest ? d : nearest;
+            }
+            std::vector<float> scratch(dist.size());
+            double n = (double)dist.size();
+            invertedPairs += (double)CountInversions(dist, scratch, 0, dist.size()) / (n * (n - 1.0) * 0.5);
+        }
+        printf("  buckets %5u: EndFrame %6.2fms, %5u draw lists, inverted pairs %.4f%%, max relative depth error %.2f%%\n",
+            bucketCount, endFrameMs, drawListCount, invertedPairs / kFrameCount * 100.0, maxDepthError * 100.0);
+    }
+    return 0;
+}
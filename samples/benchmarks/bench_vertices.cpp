@@ -0,0 +1,166 @@
+// Vertices() vs Vertex(): checks that the bulk path produces identical draw data for every primitive mode, then times
+// 10 x 200k-vertex line strips submitted per vertex and in bulk under a pushed matrix.
+#include "bench_common.h"
+#include <cstring>
+#include <vector>
+
+using namespace Im3d;
+
+namespace
+{
+
+std::vector<DrawVertex> CaptureDrawLists()
+{
+    std::vector<DrawVertex> ret;
+    for (U32 i = 0; i < GetDrawListCount(); ++i)
+    {
+        const DrawList &dl = GetDrawLists()[i];
+        ret.insert(ret.end(), dl.m_vertexData, dl.m_vertexData + dl.m_vertexCount);
+    }
+    return ret;
+}
+
+// Compare the vertex members, DrawVertex may contain padding.
+bool Equal(const DrawVertex &_a, const DrawVertex &_b)
+{
+#if IM3D_VERTEX_COMPACT
+    return memcmp(_a.m_position, _b.m_position, sizeof(_a.m_position)) == 0 && _a.m_size == _b.m_size && _a.m_color == _b.m_color;
+#else
+    return memcmp(&_a.m_positionSize, &_b.m_positionSize, sizeof(_a.m_positionSize)) == 0 && _a.m_color == _b.m_color;
+#endif
+}
+
+void BeginMode(int _mode)
+{
+    switch (_mode)
+    {
+    case 0: BeginPoints(); break;
+    case 1: BeginLines(); break;
+    case 2: BeginLineStrip(); break;
+    case 3: BeginLineLoop(); break;
+    case 4: BeginTriangles(); break;
+    default: BeginTriangleStrip(); break;
+    };
+}
+
+// Submit _count vertices per vertex (_bulk = false) or via Vertices() in increasing batch sizes.
+void Submit(int _mode, bool _bulk, bool _perVertexAttributes, const Vec3 *_positions, const Color *_colors, const float *_sizes, int _count)
+{
+    bench::SetupView(Vec3(0.0f, 2.0f, -8.0f), Vec3(0.0f));
+    NewFrame();
+    PushMatrix();
+    Translate(1.0f, 2.0f, 3.0f);
+    Rotate(Vec3(0.0f, 1.0f, 0.0f), 0.5f);
+    PushAlpha(0.5f);
+    BeginMode(_mode);
+    if (_bulk)
+    {
+        for (int i = 0, batch = 1; i < _count; i += batch, batch = batch * 2 + 1)
+        {
+            int n = batch < _count - i ? batch : _count - i;
+            Vertices(_positions + i, _perVertexAttributes ? _colors + i : nullptr, _perVertexAttributes ? _sizes + i : nullptr, n);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < _count; ++i)
+        {
+            if (_perVertexAttributes)
+            {
+                Vertex(_positions[i], _sizes[i], _colors[i]);
+            }
+            else
+            {
+                Vertex(_positions[i]);
+            }
+        }
+    }
+    End();
+    PopAlpha();
+    PopMatrix();
+    EndFrame();
+}
+
+} // namespace
+
+int main(int, char **)
+{
+    // correctness
+    const int kCheckCount = 1000;
+    std::vector<Vec3> positions;
+    std::vector<Color> colors;
+    std::vector<float> sizes;
+    for (int i = 0; i < kCheckCount; ++i)
+    {
+        positions.push_back(Vec3(sinf(i * 0.1f) * 3.0f, i * 0.01f, cosf(i * 0.3f)));
+        colors.push_back(Color(0x10203000u + i));
+        sizes.push_back(1.0f + (i % 7));
+    }
+    int failures = 0;
+    for (int mode = 0; mode < 6; ++mode)
+    {
+        const int count = mode == 1 ? kCheckCount - 2 : (mode == 4 ? kCheckCount - 1 : kCheckCount); // whole lines/triangles
+        for (int attributes = 0; attributes < 2; ++attributes)
+        {
+            Submit(mode, false, attributes != 0, positions.data(), colors.data(), sizes.data(), count);
+            std::vector<DrawVertex> ref = CaptureDrawLists();
+            Submit(mode, true, attributes != 0, positions.data(), colors.data(), sizes.data(), count);
+            std::vector<DrawVertex> bulk = CaptureDrawLists();
+            bool equal = ref.size() == bulk.size();
+            for (size_t i = 0; equal && i < ref.size(); ++i)
+            {
+                equal = Equal(ref[i], bulk[i]);
+            }
+            if (!equal)
+            {
+                printf("FAILED: mode %d attributes %d, %u vs %u vertices\n", mode, attributes, (U32)ref.size(), (U32)bulk.size());
+                ++failures;
+            }
+        }
+    }
+    printf("correctness: %d failures\n", failures);
+
+    // benchmark, min of 5 runs
+    const int kVertexCount = 200000;
+    const int kStripCount = 10;
+    std::vector<Vec3> strip(kVertexCount);
+    for (int i = 0; i < kVertexCount; ++i)
+    {
+        strip[i] = Vec3((float)i, 1.0f, 2.0f);
+    }
+    double perVertexMs = 1e9;
+    double bulkMs = 1e9;
+    for (int run = 0; run < 5; ++run)
+    {
+        bench::SetupView(Vec3(0.0f, 2.0f, -8.0f), Vec3(0.0f));
+        NewFrame();
+        PushMatrix();
+        Translate(1.0f, 2.0f, 3.0f);
+        bench::Timer timer;
+        for (int i = 0; i < kStripCount; ++i)
+        {
+            BeginLineStrip();
+            for (const Vec3 &p : strip)
+            {
+                Vertex(p);
+            }
+            End();
+        }
+        double ms = timer.ms();
+        perVertexMs = ms < perVertexMs ? ms : perVertexMs;
+        timer.reset();
+        for (int i = 0; i < kStripCount; ++i)
+        {
+            BeginLineStrip();
+            Vertices(strip.data(), nullptr, nullptr, kVertexCount);
+            End();
+        }
+        ms = timer.ms();
+        bulkMs = ms < bulkMs ? ms : bulkMs;
+        PopMatrix();
+        EndFrame();
+    }
+    printf("%d x %dk vertex line strips: Vertex() %.2fms, Vertices() %.2fms\n", kStripCount, kVertexCount / 1000, perVertexMs, bulkMs);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+// Occlusion culling correctness: with the teapot as occluder, IsOccluded() must never report a box as occluded if any point on
+// its surface is visible from the eye. Visibility is checked by brute force, ray casting a grid of points on each face of the box
+// against every occluder triangle. Returns non-zero if a false occlusion is found.
+#include "bench_common.h"
+#include <teapot.h>
+#include <random>
+#include <vector>
+
+using namespace Im3d;
+
+namespace
+{
+
+const U32 kTeapotIndexCount = sizeof(s_teapotIndices) / sizeof(s_teapotIndices[0]);
+const U32 kTeapotVertexStride = sizeof(float) * 6; // position, normal
+const int kFaceSamples = 12; // grid of (kFaceSamples + 1)^2 points per box face
+
+// Möller-Trumbore, return the ray parameter of the intersection in _t_.
+bool RayTriangle(const Vec3 &_origin, const Vec3 &_direction, const Vec3 &_a, const Vec3 &_b, const Vec3 &_c, float &_t_)
+{
+    Vec3 e1 = _b - _a;
+    Vec3 e2 = _c - _a;
+    Vec3 p = Cross(_direction, e2);
+    float det = Dot(e1, p);
+    if (fabsf(det) < 1e-12f)
+    {
+        return false;
+    }
+    float invDet = 1.0f / det;
+    Vec3 s = _origin - _a;
+    float u = Dot(s, p) * invDet;
+    if (u < 0.0f || u > 1.0f)
+    {
+        return false;
+    }
+    Vec3 q = Cross(s, e1);
+    float v = Dot(_direction, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f)
+    {
+        return false;
+    }
+    _t_ = Dot(e2, q) * invDet;
+    return true;
+}
+
+// If no triangle in _triangles intersects the segment _eye -> _point.
+bool PointVisible(const Vec3 &_eye, const Vec3 &_point, const std::vector<Vec3> &_triangles)
+{
+    Vec3 d = _point - _eye;
+    for (size_t i = 0; i < _triangles.size(); i += 3)
+    {
+        float t;
+        if (RayTriangle(_eye, d, _triangles[i], _triangles[i + 1], _triangles[i + 2], t) && t > 1e-4f && t < 1.0f - 1e-4f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BoxVisible(const Vec3 &_eye, const Vec3 &_min, const Vec3 &_max, const std::vector<Vec3> &_triangles)
+{
+    for (int face = 0; face < 6; ++face)
+    {
+        const int axis = face / 2;
+        for (int i = 0; i <= kFaceSamples; ++i)
+        {
+            for (int j = 0; j <= kFaceSamples; ++j)
+            {
+                float q[3];
+                q[axis] = (face & 1) ? 1.0f : 0.0f;
+                q[(axis + 1) % 3] = (float)i / kFaceSamples;
+                q[(axis + 2) % 3] = (float)j / kFaceSamples;
+                Vec3 p(_min.x + (_max.x - _min.x) * q[0], _min.y + (_max.y - _min.y) * q[1], _min.z + (_max.z - _min.z) * q[2]);
+                if (PointVisible(_eye, p, _triangles))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+int main(int, char **)
+{
+    const int kBoxCount = 3000;
+    const Mat4 model(Vec3(0.0f), Mat3(1.0f), Vec3(8.0f));
+    std::vector<Vec3> triangles; // world space
+    for (U32 i = 0; i < kTeapotIndexCount; ++i)
+    {
+        const float *v = s_teapotVertices + s_teapotIndices[i] * 6;
+        triangles.push_back(model * Vec3(v[0], v[1], v[2]));
+    }
+
+    const Vec3 target(0.0f, 0.6f, 0.0f);
+    const Vec3 eyes[] = {Vec3(0.3f, 1.2f, -4.0f), Vec3(-3.0f, 2.5f, -2.5f), Vec3(2.0f, 0.2f, -3.0f)};
+    int failures = 0;
+    for (const Vec3 &eye : eyes)
+    {
+        bench::SetupView(eye, target, 0.8f, 0.1f, 100.0f);
+        NewFrame();
+        PushMatrix(model);
+        Occluders((const Vec3 *)s_teapotVertices, kTeapotVertexStride, s_teapotIndices, kTeapotIndexCount);
+        PopMatrix();
+
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> x(-2.5f, 2.5f), y(-0.5f, 2.5f), z(-1.0f, 4.0f), size(0.02f, 0.3f);
+        int occluded = 0;
+        int hidden = 0;
+        int falseOcclusions = 0;
+        for (int i = 0; i < kBoxCount; ++i)
+        {
+            Vec3 center(x(rng), y(rng), z(rng));
+            Vec3 extent(size(rng));
+            bool isOccluded = IsOccluded(center - extent, center + extent);
+            bool visible = BoxVisible(eye, center - extent, center + extent, triangles);
+            occluded += isOccluded ? 1 : 0;
+            hidden += visible ? 0 : 1;
+            if (isOccluded && visible)
+            {
+                ++falseOcclusions;
+            }
+        }
+        EndFrame();
+        printf("eye (%5.2f, %5.2f, %5.2f): %d boxes, %d occluded, %d hidden (brute force), %d false occlusions\n",
+            eye.x, eye.y, eye.z, kBoxCount, occluded, hidden, falseOcclusions);
+        failures += falseOcclusions;
+    }
+    return failures == 0 ? 0 : 1;
+}
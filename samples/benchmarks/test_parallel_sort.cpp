@@ -0,0 +1,114 @@
+// Sorting with a threaded AppData::parallelForCallback: 8 sorted layers of triangles, lines and points over several frames (a
+// moving view, then a static view to exercise the reuse of the previous frame's order). Each frame is submitted twice, with the
+// callback and without it, and the draw lists must be identical. Returns non-zero on a mismatch. Build with a thread sanitizer
+// to check that the sort tasks don't race (e.g. on the frame arena).
+#include "bench_common.h"
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace Im3d;
+
+namespace
+{
+
+const int kLayerCount = 8;
+const int kThreadCount = 8;
+const int kFrameCount = 12;
+
+void ThreadParallelFor(U32 _count, ParallelTaskCallback *_task, void *_taskData)
+{
+    std::atomic<U32> next(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreadCount; ++i)
+    {
+        threads.emplace_back([&]() {
+            for (U32 j = next++; j < _count; j = next++)
+            {
+                _task(j, _taskData);
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void Submit(int _frame, bool _parallel)
+{
+    // the view moves for the first half of the frames, then stays put
+    const float t = (float)(_frame < kFrameCount / 2 ? _frame : kFrameCount / 2) * 0.3f;
+    bench::SetupView(Vec3(sinf(t) * 12.0f, 4.0f, -cosf(t) * 12.0f), Vec3(0.0f));
+    GetAppData().parallelForCallback = _parallel ? &ThreadParallelFor : nullptr;
+    NewFrame();
+    for (int layer = 0; layer < kLayerCount; ++layer)
+    {
+        PushLayerId(MakeId(layer));
+        PushEnableSorting(true);
+        PushColor(Color(0.1f * (float)layer, 0.5f, 0.8f, 0.5f));
+        for (int i = 0; i < 200; ++i)
+        {
+            const Vec3 p((float)(i % 10) - 5.0f, (float)layer * 0.5f, (float)(i / 10) * 0.5f - 5.0f);
+            BeginTriangles();
+            Vertex(p);
+            Vertex(p + Vec3(0.4f, 0.0f, 0.0f));
+            Vertex(p + Vec3(0.0f, 0.4f, 0.1f));
+            End();
+            BeginLines();
+            Vertex(p);
+            Vertex(p + Vec3(0.0f, 0.0f, 0.4f));
+            End();
+            BeginPoints();
+            Vertex(p + Vec3(0.2f), 4.0f);
+            End();
+        }
+        PopColor();
+        PopEnableSorting();
+        PopLayerId();
+    }
+    EndFrame();
+}
+
+// The draw lists of the last EndFrame() as bytes.
+std::vector<char> Capture()
+{
+    std::vector<char> ret;
+    for (U32 i = 0; i < GetDrawListCount(); ++i)
+    {
+        const DrawList &dl = GetDrawLists()[i];
+        const char *header = (const char *)&dl.m_layerId;
+        ret.insert(ret.end(), header, header + sizeof(Id));
+        header = (const char *)&dl.m_primType;
+        ret.insert(ret.end(), header, header + sizeof(DrawPrimitiveType));
+        ret.insert(ret.end(), (const char *)dl.m_vertexData, (const char *)(dl.m_vertexData + dl.m_vertexCount));
+        if (dl.m_indexData)
+        {
+            ret.insert(ret.end(), (const char *)dl.m_indexData, (const char *)(dl.m_indexData + dl.m_indexCount));
+        }
+    }
+    return ret;
+}
+
+} // namespace
+
+int main(int, char **)
+{
+    int failures = 0;
+    for (int frame = 0; frame < kFrameCount; ++frame)
+    {
+        Submit(frame, false);
+        std::vector<char> serial = Capture();
+        U32 serialCount = GetDrawListCount();
+        Submit(frame, true);
+        std::vector<char> parallel = Capture();
+        if (serialCount != GetDrawListCount() || serial.size() != parallel.size() || memcmp(serial.data(), parallel.data(), serial.size()) != 0)
+        {
+            printf("FAILED: frame %d, %u vs %u draw lists\n", frame, serialCount, GetDrawListCount());
+            ++failures;
+        }
+    }
+    printf("%d frames, %d layers, %d threads: %d failures\n", kFrameCount, kLayerCount, kThreadCount, failures);
+    return failures == 0 ? 0 : 1;
+}